@@ -0,0 +1,688 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#include "physic.hpp"
+#include "grid.hpp"
+#include "agent.hpp"
+#include "flow_field.hpp"
+#include "visibility_cache.hpp"
+
+
+// Headless benchmarks of the solver and grid hot paths, results are written as JSON on stdout
+// Usage: HordBench [--quick] [--steps=N] [--broad-phase=N] [--solve-mode=N] [--threads=N] [--no-sleep] [--adaptive]
+
+struct BenchConfig
+{
+	bool quick = false;
+	uint32_t warmup_steps = 60;
+	uint32_t measured_steps = 240;
+	Solver::BroadPhase broad_phase = Solver::BroadPhase::SpatialHash;
+	Solver::SolveMode solve_mode = Solver::SolveMode::Sequential;
+	uint32_t threads_count = 0;
+	bool allow_sleeping = true;
+	bool adaptive_iterations = false;
+};
+
+
+struct JsonObject
+{
+	JsonObject& add(const std::string& key, const std::string& value)
+	{
+		addKey(key) << '"' << value << '"';
+		return *this;
+	}
+
+	JsonObject& add(const std::string& key, const char* value)
+	{
+		return add(key, std::string(value));
+	}
+
+	JsonObject& add(const std::string& key, const JsonObject& value)
+	{
+		addKey(key) << value.str();
+		return *this;
+	}
+
+	JsonObject& add(const std::string& key, bool value)
+	{
+		addKey(key) << (value ? "true" : "false");
+		return *this;
+	}
+
+	template<typename T>
+	JsonObject& add(const std::string& key, T value)
+	{
+		addKey(key) << value;
+		return *this;
+	}
+
+	std::string str() const
+	{
+		return "{" + out.str() + "}";
+	}
+
+private:
+	std::ostringstream out;
+
+	std::ostream& addKey(const std::string& key)
+	{
+		if (out.tellp() > 0) {
+			out << ", ";
+		}
+		out << '"' << key << "\": ";
+		return out;
+	}
+};
+
+
+// Accumulates solver phase timings to report averages per step
+struct PhaseTimes
+{
+	StepTimings sum;
+	uint32_t steps_count = 0;
+
+	void add(const StepTimings& timings)
+	{
+		sum.integration_ns += timings.integration_ns;
+		sum.contacts_ns += timings.contacts_ns;
+		sum.islands_ns += timings.islands_ns;
+		sum.solve_ns += timings.solve_ns;
+		sum.positions_ns += timings.positions_ns;
+		sum.sleeping_ns += timings.sleeping_ns;
+		++steps_count;
+	}
+
+	JsonObject toJson() const
+	{
+		const uint64_t steps = steps_count ? steps_count : 1;
+		JsonObject result;
+		result.add("integration", sum.integration_ns / steps)
+			  .add("contacts", sum.contacts_ns / steps)
+			  .add("islands", sum.islands_ns / steps)
+			  .add("solve", sum.solve_ns / steps)
+			  .add("positions", sum.positions_ns / steps)
+			  .add("sleeping", sum.sleeping_ns / steps)
+			  .add("total", sum.getTotal() / steps);
+		return result;
+	}
+};
+
+
+const float atom_radius = 8.0f;
+const float dt = 0.016f;
+
+
+void setupSolver(Solver& solver, const BenchConfig& config)
+{
+	solver.broad_phase = config.broad_phase;
+	solver.solve_mode = config.solve_mode;
+	solver.threads_count = config.threads_count;
+	solver.allow_sleeping = config.allow_sleeping;
+	solver.iterations_settings.adaptive = config.adaptive_iterations;
+}
+
+// Static body made of atoms around the world, same as the demo
+void addWalls(Solver& solver, float width, float height)
+{
+	solver.addObject().moving = false;
+	const float step = 2.0f * atom_radius;
+	for (uint32_t x(0); x < width / step; ++x) {
+		solver.addAtomToLastObject(Vec2(x * step, height));
+		solver.addAtomToLastObject(Vec2(x * step, 0.0f));
+	}
+	for (uint32_t y(0); y < height / step; ++y) {
+		solver.addAtomToLastObject(Vec2(0.0f, y * step));
+		solver.addAtomToLastObject(Vec2(width, y * step));
+	}
+}
+
+void addBox(Solver& solver, const Vec2& position, float angular_velocity)
+{
+	solver.addObject().angular_velocity = angular_velocity;
+	for (uint32_t x(0); x < 5; ++x) {
+		for (uint32_t y(0); y < 5; ++y) {
+			solver.addAtomToLastObject(position.plus(Vec2(x * 2.0f * atom_radius, y * 2.0f * atom_radius)));
+		}
+	}
+}
+
+JsonObject runSolver(Solver& solver, const BenchConfig& config, const char* scene, uint32_t n)
+{
+	for (uint32_t i(config.warmup_steps); i--;) {
+		solver.update(dt);
+	}
+	PhaseTimes times;
+	uint64_t iterations_sum = 0;
+	double residual_sum = 0.0;
+	for (uint32_t i(config.measured_steps); i--;) {
+		solver.update(dt);
+		times.add(solver.step_timings);
+		iterations_sum += solver.convergence_stats.iterations_count;
+		residual_sum += solver.convergence_stats.residual;
+	}
+
+	JsonObject result;
+	result.add("scene", scene)
+		  .add("n", n)
+		  .add("atoms", solver.atoms.size())
+		  .add("contacts", solver.atom_contacts.size())
+		  .add("steps", config.measured_steps)
+		  .add("iterations_per_step", static_cast<double>(iterations_sum) / config.measured_steps)
+		  .add("residual", residual_sum / config.measured_steps)
+		  .add("ns_per_step", times.toJson());
+	return result;
+}
+
+// N boxes falling on each other, rows of 14 boxes
+JsonObject benchPile(const BenchConfig& config, uint32_t n)
+{
+	const uint32_t per_row = 14;
+	const uint32_t rows_count = (n + per_row - 1) / per_row;
+	const float width = 1600.0f;
+	const float height = std::max(900.0f, rows_count * 100.0f + 300.0f);
+
+	Solver solver;
+	setupSolver(solver, config);
+	addWalls(solver, width, height);
+	for (uint32_t i(0); i < n; ++i) {
+		const uint32_t column = i % per_row;
+		const uint32_t row = i / per_row;
+		addBox(solver, Vec2(100.0f + column * 100.0f + (row % 2) * 20.0f, height - 250.0f - row * 100.0f), -2.0f);
+	}
+	return runSolver(solver, config, "pile", n);
+}
+
+// Same pile with the walls made of solid grid cells instead of atoms
+JsonObject benchPileGrid(const BenchConfig& config, uint32_t n)
+{
+	const uint32_t per_row = 14;
+	const uint32_t rows_count = (n + per_row - 1) / per_row;
+	const float width = 1600.0f;
+	const float height = std::max(900.0f, rows_count * 100.0f + 300.0f);
+
+	// Walls' inner faces where the atoms' ones are
+	const int32_t cell_size = static_cast<int32_t>(2.0f * atom_radius);
+	const int32_t grid_width = static_cast<int32_t>(width) / cell_size + 1;
+	const int32_t grid_height = static_cast<int32_t>(height) / cell_size + 1;
+	Grid grid(cell_size, grid_width, grid_height);
+	for (int32_t x(0); x < grid_width; ++x) {
+		grid.setCellAt(x, 0, 1);
+		grid.setCellAt(x, grid_height - 1, 1);
+	}
+	for (int32_t y(0); y < grid_height; ++y) {
+		grid.setCellAt(0, y, 1);
+		grid.setCellAt(grid_width - 1, y, 1);
+	}
+
+	Solver solver;
+	setupSolver(solver, config);
+	solver.setGrid(&grid);
+	for (uint32_t i(0); i < n; ++i) {
+		const uint32_t column = i % per_row;
+		const uint32_t row = i / per_row;
+		addBox(solver, Vec2(100.0f + column * 100.0f + (row % 2) * 20.0f, height - 250.0f - row * 100.0f), -2.0f);
+	}
+	return runSolver(solver, config, "pile_grid", n);
+}
+
+// Single column of N boxes resting on the floor
+JsonObject benchStack(const BenchConfig& config, uint32_t n)
+{
+	const float box_size = 10.0f * atom_radius;
+	const float width = 400.0f;
+	const float height = n * (box_size + 2.0f) + 200.0f;
+
+	Solver solver;
+	setupSolver(solver, config);
+	addWalls(solver, width, height);
+	for (uint32_t i(0); i < n; ++i) {
+		addBox(solver, Vec2(0.5f * width - 2.0f * atom_radius, height - (i + 1) * (box_size + 2.0f)), 0.0f);
+	}
+	return runSolver(solver, config, "stack", n);
+}
+
+// Single atom bodies spawned like the demo's pause mode, timed once n particles are in
+JsonObject benchFlood(const BenchConfig& config, uint32_t n)
+{
+	const uint32_t spawners_count = 8;
+	std::mt19937 generator(0);
+
+	Solver solver;
+	setupSolver(solver, config);
+	addWalls(solver, 1600.0f, 900.0f);
+	for (uint32_t spawned(0); spawned < n;) {
+		for (uint32_t i(0); i < spawners_count && spawned < n; ++i, ++spawned) {
+			solver.addObject();
+			solver.addAtomToLastObject(Vec2(400.0f + i * 100.0f + generator() % 2, 350.0f));
+		}
+		solver.update(dt);
+	}
+	return runSolver(solver, config, "flood", n);
+}
+
+// Perfect maze carved with a depth first search, walls are cells set to 1
+void generateMaze(Grid& grid, int32_t width, int32_t height, std::mt19937& generator)
+{
+	for (int32_t x(0); x < width; ++x) {
+		for (int32_t y(0); y < height; ++y) {
+			grid.setCellAt(x, y, 1);
+		}
+	}
+
+	const int32_t directions[4][2] = { {2, 0}, {-2, 0}, {0, 2}, {0, -2} };
+	std::vector<std::pair<int32_t, int32_t>> stack;
+	stack.emplace_back(1, 1);
+	grid.setCellAt(1, 1, 0);
+	while (!stack.empty()) {
+		const int32_t x = stack.back().first;
+		const int32_t y = stack.back().second;
+		int32_t candidates[4];
+		uint32_t candidates_count = 0;
+		for (int32_t d(0); d < 4; ++d) {
+			const int32_t nx = x + directions[d][0];
+			const int32_t ny = y + directions[d][1];
+			if (nx > 0 && ny > 0 && nx < width - 1 && ny < height - 1 && grid.getCellContentAt(nx, ny) == 1) {
+				candidates[candidates_count++] = d;
+			}
+		}
+		if (!candidates_count) {
+			stack.pop_back();
+			continue;
+		}
+		const int32_t d = candidates[generator() % candidates_count];
+		grid.setCellAt(x + directions[d][0] / 2, y + directions[d][1] / 2, 0);
+		grid.setCellAt(x + directions[d][0], y + directions[d][1], 0);
+		stack.emplace_back(x + directions[d][0], y + directions[d][1]);
+	}
+}
+
+// Batch of n rays between random empty cells of a maze
+JsonObject benchRays(const BenchConfig& config, uint32_t n)
+{
+	const int32_t cell_size = 20;
+	const int32_t width = 81;
+	const int32_t height = 45;
+	std::mt19937 generator(0);
+	Grid grid(cell_size, width, height);
+	generateMaze(grid, width, height, generator);
+
+	std::vector<sf::Vector2f> empty_cells;
+	for (int32_t x(0); x < width; ++x) {
+		for (int32_t y(0); y < height; ++y) {
+			if (!grid.getCellContentAt(x, y)) {
+				empty_cells.emplace_back((x + 0.5f) * cell_size, (y + 0.5f) * cell_size);
+			}
+		}
+	}
+	std::vector<sf::Vector2f> starts(n);
+	std::vector<sf::Vector2f> ends(n);
+	for (uint32_t i(0); i < n; ++i) {
+		starts[i] = empty_cells[generator() % empty_cells.size()];
+		ends[i] = empty_cells[generator() % empty_cells.size()];
+		if (starts[i].x == ends[i].x && starts[i].y == ends[i].y) {
+			ends[i].x += 1.0f;
+		}
+	}
+
+	const uint32_t repeats_count = config.quick ? 2 : 8;
+	uint64_t hits_count = 0;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t r(repeats_count); r--;) {
+		for (uint32_t i(0); i < n; ++i) {
+			hits_count += grid.castRayToPoint(starts[i], ends[i]).hit;
+		}
+	}
+	const uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	const uint64_t rays_count = static_cast<uint64_t>(n) * repeats_count;
+
+	// Same rays through the batch API, on one thread then on the pool
+	ThreadPool thread_pool(config.threads_count);
+	RayHits hits;
+	uint64_t batched_ns[2];
+	for (uint32_t k(0); k < 2; ++k) {
+		const std::chrono::steady_clock::time_point batch_start = std::chrono::steady_clock::now();
+		for (uint32_t r(repeats_count); r--;) {
+			grid.castRays(starts.data(), ends.data(), n, hits, k ? &thread_pool : nullptr);
+		}
+		batched_ns[k] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - batch_start).count();
+	}
+	uint32_t mismatches_count = 0;
+	for (uint32_t i(0); i < n; ++i) {
+		const HitPoint expected = grid.castRayToPoint(starts[i], ends[i]);
+		const HitPoint batched = hits.get(i);
+		mismatches_count += expected.hit != batched.hit || expected.distance != batched.distance ||
+			                expected.cell_x != batched.cell_x || expected.cell_y != batched.cell_y;
+	}
+
+	JsonObject result;
+	result.add("scene", "rays")
+		  .add("n", n)
+		  .add("grid_width", width)
+		  .add("grid_height", height)
+		  .add("hit_ratio", static_cast<double>(hits_count) / rays_count)
+		  .add("ns_per_ray", static_cast<double>(elapsed_ns) / rays_count)
+		  .add("ns_per_batch", elapsed_ns / repeats_count)
+		  .add("ns_per_ray_batched", static_cast<double>(batched_ns[0]) / rays_count)
+		  .add("ns_per_ray_batched_threads", static_cast<double>(batched_ns[1]) / rays_count)
+		  .add("batched_mismatches", mismatches_count);
+	return result;
+}
+
+
+// Long rays across a large world of scattered wall segments, stored densely then in chunks
+JsonObject benchWorldRays(const BenchConfig& config, int32_t size)
+{
+	const int32_t cell_size = 10;
+	const uint32_t n = 4096;
+	std::mt19937 generator(0);
+	Grid dense(cell_size, size, size);
+	Grid chunked(cell_size, size, size, Grid::Storage::Chunked);
+	const int32_t segments_count = size * size / 2048;
+	for (int32_t i(0); i < segments_count; ++i) {
+		const int32_t x = generator() % size;
+		const int32_t y = generator() % size;
+		for (int32_t k(0); k < 16; ++k) {
+			dense.setCellAt(std::min(size - 1, x + k), y, 1);
+			chunked.setCellAt(std::min(size - 1, x + k), y, 1);
+		}
+	}
+
+	const float world_size = static_cast<float>(size * cell_size);
+	std::uniform_real_distribution<float> coordinate(0.0f, world_size);
+	std::vector<sf::Vector2f> starts(n);
+	std::vector<sf::Vector2f> ends(n);
+	for (uint32_t i(0); i < n; ++i) {
+		starts[i] = sf::Vector2f(coordinate(generator), coordinate(generator));
+		ends[i] = sf::Vector2f(coordinate(generator), coordinate(generator));
+	}
+
+	const uint32_t repeats_count = config.quick ? 1 : 4;
+	const Grid* grids[2] = { &dense, &chunked };
+	uint64_t elapsed_ns[2];
+	uint64_t hits_count = 0;
+	for (uint32_t g(0); g < 2; ++g) {
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint32_t r(repeats_count); r--;) {
+			for (uint32_t i(0); i < n; ++i) {
+				hits_count += grids[g]->castRayToPoint(starts[i], ends[i]).hit;
+			}
+		}
+		elapsed_ns[g] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+	// Same rays through the batch API on one thread, the batches of both grids must match the dense single rays
+	RayHits hits[2];
+	uint64_t batched_ns[2];
+	for (uint32_t g(0); g < 2; ++g) {
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint32_t r(repeats_count); r--;) {
+			grids[g]->castRays(starts.data(), ends.data(), n, hits[g]);
+		}
+		batched_ns[g] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+	uint32_t mismatches_count = 0;
+	uint32_t batched_mismatches_count = 0;
+	for (uint32_t i(0); i < n; ++i) {
+		const HitPoint expected = dense.castRayToPoint(starts[i], ends[i]);
+		const HitPoint hit = chunked.castRayToPoint(starts[i], ends[i]);
+		mismatches_count += expected.hit != hit.hit || expected.distance != hit.distance ||
+			                expected.cell_x != hit.cell_x || expected.cell_y != hit.cell_y;
+		for (const RayHits& batch : hits) {
+			const HitPoint batched = batch.get(i);
+			batched_mismatches_count += expected.hit != batched.hit || expected.distance != batched.distance ||
+				                        expected.cell_x != batched.cell_x || expected.cell_y != batched.cell_y;
+		}
+	}
+
+	const uint64_t rays_count = static_cast<uint64_t>(n) * repeats_count;
+	JsonObject result;
+	result.add("scene", "world_rays")
+		  .add("grid_size", size)
+		  .add("hit_ratio", static_cast<double>(hits_count) / (2 * rays_count))
+		  .add("ns_per_ray_dense", static_cast<double>(elapsed_ns[0]) / rays_count)
+		  .add("ns_per_ray_chunked", static_cast<double>(elapsed_ns[1]) / rays_count)
+		  .add("ns_per_ray_dense_batched", static_cast<double>(batched_ns[0]) / rays_count)
+		  .add("ns_per_ray_chunked_batched", static_cast<double>(batched_ns[1]) / rays_count)
+		  .add("bytes_dense", dense.getMemoryUsage())
+		  .add("bytes_chunked", chunked.getMemoryUsage())
+		  .add("chunked_mismatches", mismatches_count)
+		  .add("batched_mismatches", batched_mismatches_count);
+	return result;
+}
+
+// n agents chasing the same target in a maze, with a line of sight ray each, with cached line of sight
+// results then with a shared flow field
+JsonObject benchAgents(const BenchConfig& config, uint32_t n)
+{
+	const int32_t cell_size = 20;
+	const int32_t width = 81;
+	const int32_t height = 45;
+	const float dt = 0.016f;
+	const uint32_t frames_count = config.quick ? 300 : 1200;
+	std::mt19937 generator(0);
+	Grid grid(cell_size, width, height);
+	generateMaze(grid, width, height, generator);
+
+	std::vector<Agent> agents;
+	for (uint32_t i(0); i < n; ++i) {
+		int32_t x, y;
+		do {
+			x = generator() % width;
+			y = generator() % height;
+		} while (grid.getCellContentAt(x, y));
+		agents.emplace_back((x + 0.5f) * cell_size, (y + 0.5f) * cell_size);
+	}
+	// Maze corridors are on odd cells
+	const sf::Vector2f target(((width / 2 | 1) + 0.5f) * cell_size, ((height / 2 | 1) + 0.5f) * cell_size);
+	const auto reached_count = [&](const std::vector<Agent>& moved) {
+		uint32_t count = 0;
+		for (const Agent& agent : moved) {
+			count += Tools::length(agent.position - target) < cell_size;
+		}
+		return count;
+	};
+
+	AgentsUpdater updater;
+	std::vector<Agent> ray_agents = agents;
+	const std::chrono::steady_clock::time_point rays_start = std::chrono::steady_clock::now();
+	for (uint32_t f(frames_count); f--;) {
+		updater.update(ray_agents, target, grid, dt);
+	}
+	const uint64_t rays_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - rays_start).count();
+
+	std::vector<Agent> cached_agents = agents;
+	VisibilityCache cache;
+	const std::chrono::steady_clock::time_point cached_start = std::chrono::steady_clock::now();
+	for (uint32_t f(frames_count); f--;) {
+		updater.update(cached_agents, target, grid, cache, dt);
+	}
+	const uint64_t cached_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - cached_start).count();
+
+	std::vector<Agent> flow_agents = agents;
+	FlowField flow_field;
+	uint32_t rebuilds_count = 0;
+	const std::chrono::steady_clock::time_point flow_start = std::chrono::steady_clock::now();
+	for (uint32_t f(frames_count); f--;) {
+		rebuilds_count += flow_field.update(grid, target);
+		updater.update(flow_agents, flow_field, dt);
+	}
+	const uint64_t flow_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - flow_start).count();
+
+	const uint64_t updates_count = static_cast<uint64_t>(n) * frames_count;
+	JsonObject result;
+	result.add("scene", "agents")
+		  .add("n", n)
+		  .add("frames", frames_count)
+		  .add("ns_per_agent_rays", static_cast<double>(rays_ns) / updates_count)
+		  .add("ns_per_agent_rays_cached", static_cast<double>(cached_ns) / updates_count)
+		  .add("visibility_cache_hit_ratio", static_cast<double>(cache.getHitsCount()) / (cache.getHitsCount() + cache.getMissesCount()))
+		  .add("ns_per_agent_flow_field", static_cast<double>(flow_ns) / updates_count)
+		  .add("flow_field_rebuilds", rebuilds_count)
+		  .add("reached_ratio_rays", static_cast<double>(reached_count(ray_agents)) / n)
+		  .add("reached_ratio_flow_field", static_cast<double>(reached_count(flow_agents)) / n);
+	return result;
+}
+
+// Building N square bodies of atoms with varying masses, one atom at a time and with the bulk builder.
+// Both must give the same mass properties
+JsonObject benchSpawn(const BenchConfig& config, uint32_t n)
+{
+	const uint32_t side = config.quick ? 10 : 20;
+	std::vector<Vec2> local_positions;
+	std::vector<float> masses;
+	for (uint32_t x(0); x < side; ++x) {
+		for (uint32_t y(0); y < side; ++y) {
+			local_positions.emplace_back(x * 2.0f * atom_radius, y * 2.0f * atom_radius);
+			masses.push_back(1.0f + (x + y) % 3);
+		}
+	}
+	const auto get_position = [&](uint32_t i) {
+		return Vec2((i % 64) * side * 2.0f * atom_radius, (i / 64) * side * 2.0f * atom_radius);
+	};
+
+	Solver incremental_solver;
+	const std::chrono::steady_clock::time_point incremental_start = std::chrono::steady_clock::now();
+	for (uint32_t i(0); i < n; ++i) {
+		incremental_solver.addObject();
+		for (uint64_t k(0); k < local_positions.size(); ++k) {
+			incremental_solver.addAtomToLastObject(get_position(i).plus(local_positions[k]), masses[k]);
+		}
+	}
+	const uint64_t incremental_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - incremental_start).count();
+
+	Solver bulk_solver;
+	const std::chrono::steady_clock::time_point bulk_start = std::chrono::steady_clock::now();
+	for (uint32_t i(0); i < n; ++i) {
+		bulk_solver.addObject(get_position(i), local_positions, masses);
+	}
+	const uint64_t bulk_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - bulk_start).count();
+
+	double inertia_error = 0.0;
+	double center_of_mass_error = 0.0;
+	for (uint32_t i(0); i < n; ++i) {
+		const ComposedObject& incremental = incremental_solver.objects[i];
+		const ComposedObject& bulk = bulk_solver.objects[i];
+		inertia_error = std::max(inertia_error, std::abs(static_cast<double>(incremental.intertia) - bulk.intertia) / bulk.intertia);
+		center_of_mass_error = std::max(center_of_mass_error, static_cast<double>((incremental.center_of_mass - bulk.center_of_mass).getLength()));
+	}
+
+	JsonObject result;
+	result.add("scene", "spawn")
+		  .add("n", n)
+		  .add("atoms", bulk_solver.atoms.size())
+		  .add("ns_per_atom_incremental", static_cast<double>(incremental_ns) / bulk_solver.atoms.size())
+		  .add("ns_per_atom_bulk", static_cast<double>(bulk_ns) / bulk_solver.atoms.size())
+		  .add("inertia_max_relative_error", inertia_error)
+		  .add("center_of_mass_max_error", center_of_mass_error);
+	return result;
+}
+
+bool readOption(const char* arg, const char* name, uint32_t& value)
+{
+	const size_t length = std::strlen(name);
+	if (std::strncmp(arg, name, length) || arg[length] != '=') {
+		return false;
+	}
+	value = static_cast<uint32_t>(std::strtoul(arg + length + 1, nullptr, 10));
+	return true;
+}
+
+bool parseArguments(int argc, char** argv, BenchConfig& config)
+{
+	for (int i(1); i < argc; ++i) {
+		uint32_t value = 0;
+		if (!std::strcmp(argv[i], "--quick")) {
+			config.quick = true;
+			config.warmup_steps = 20;
+			config.measured_steps = 60;
+		}
+		else if (!std::strcmp(argv[i], "--no-sleep")) {
+			config.allow_sleeping = false;
+		}
+		else if (!std::strcmp(argv[i], "--adaptive")) {
+			config.adaptive_iterations = true;
+		}
+		else if (readOption(argv[i], "--steps", value)) {
+			config.measured_steps = std::max(1u, value);
+		}
+		else if (readOption(argv[i], "--broad-phase", value) && value <= 4) {
+			config.broad_phase = static_cast<Solver::BroadPhase>(value);
+		}
+		else if (readOption(argv[i], "--solve-mode", value) && value <= 3) {
+			config.solve_mode = static_cast<Solver::SolveMode>(value);
+		}
+		else if (readOption(argv[i], "--threads", value)) {
+			config.threads_count = value;
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--quick] [--steps=N] [--broad-phase=0-4] [--solve-mode=0-3] [--threads=N] [--no-sleep] [--adaptive]" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!parseArguments(argc, argv, config)) {
+		return 1;
+	}
+
+	const std::vector<uint32_t> pile_sizes = config.quick ? std::vector<uint32_t>{ 10, 40 } : std::vector<uint32_t>{ 10, 20, 40, 80, 160 };
+	const std::vector<uint32_t> stack_sizes = config.quick ? std::vector<uint32_t>{ 5, 10 } : std::vector<uint32_t>{ 5, 10, 20, 40 };
+	const std::vector<uint32_t> flood_sizes = config.quick ? std::vector<uint32_t>{ 250, 500 } : std::vector<uint32_t>{ 250, 500, 1000, 2000, 4000 };
+	const std::vector<uint32_t> rays_sizes = config.quick ? std::vector<uint32_t>{ 1024, 4096 } : std::vector<uint32_t>{ 1024, 4096, 16384, 65536 };
+	const std::vector<uint32_t> agents_sizes = config.quick ? std::vector<uint32_t>{ 256 } : std::vector<uint32_t>{ 256, 1024, 4096 };
+	const std::vector<uint32_t> spawn_sizes = config.quick ? std::vector<uint32_t>{ 100 } : std::vector<uint32_t>{ 100, 1000 };
+	const std::vector<int32_t> world_sizes = config.quick ? std::vector<int32_t>{ 1024 } : std::vector<int32_t>{ 1024, 4096, 8192 };
+
+	std::vector<JsonObject> results;
+	for (uint32_t n : pile_sizes) {
+		results.push_back(benchPile(config, n));
+	}
+	for (uint32_t n : pile_sizes) {
+		results.push_back(benchPileGrid(config, n));
+	}
+	for (uint32_t n : stack_sizes) {
+		results.push_back(benchStack(config, n));
+	}
+	for (uint32_t n : flood_sizes) {
+		results.push_back(benchFlood(config, n));
+	}
+	for (uint32_t n : rays_sizes) {
+		results.push_back(benchRays(config, n));
+	}
+	for (uint32_t n : agents_sizes) {
+		results.push_back(benchAgents(config, n));
+	}
+	for (int32_t size : world_sizes) {
+		results.push_back(benchWorldRays(config, size));
+	}
+	for (uint32_t n : spawn_sizes) {
+		results.push_back(benchSpawn(config, n));
+	}
+
+	JsonObject json_config;
+	json_config.add("warmup_steps", config.warmup_steps)
+			   .add("measured_steps", config.measured_steps)
+			   .add("broad_phase", static_cast<uint32_t>(config.broad_phase))
+			   .add("solve_mode", static_cast<uint32_t>(config.solve_mode))
+			   .add("threads", config.threads_count)
+			   .add("allow_sleeping", config.allow_sleeping)
+			   .add("adaptive_iterations", config.adaptive_iterations);
+
+	std::cout << "{\n\t\"config\": " << json_config.str() << ",\n\t\"results\": [\n";
+	for (uint64_t i(0); i < results.size(); ++i) {
+		std::cout << "\t\t" << results[i].str() << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	std::cout << "\t]\n}" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,256 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "vec.hpp"
+
+
+struct AABB
+{
+	AABB()
+		: min()
+		, max()
+	{}
+
+	AABB(const Vec2& min_, const Vec2& max_)
+		: min(min_)
+		, max(max_)
+	{}
+
+	bool overlaps(const AABB& other) const
+	{
+		return min.x < other.max.x && other.min.x < max.x && min.y < other.max.y && other.min.y < max.y;
+	}
+
+	bool contains(const AABB& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && other.max.x <= max.x && other.max.y <= max.y;
+	}
+
+	AABB merge(const AABB& other) const
+	{
+		return AABB(Vec2(std::min(min.x, other.min.x), std::min(min.y, other.min.y)),
+			        Vec2(std::max(max.x, other.max.x), std::max(max.y, other.max.y)));
+	}
+
+	AABB getExpanded(float margin) const
+	{
+		return AABB(Vec2(min.x - margin, min.y - margin), Vec2(max.x + margin, max.y + margin));
+	}
+
+	float getPerimeter() const
+	{
+		return 2.0f * ((max.x - min.x) + (max.y - min.y));
+	}
+
+	Vec2 min, max;
+};
+
+
+// Bounding volume hierarchy of fattened boxes, leaves are only reinserted when their
+// tight box leaves the fat one, ancestors are refitted on the way up
+template<typename TData>
+struct AABBTree
+{
+	static constexpr int32_t null_node = -1;
+
+	struct Node
+	{
+		AABB box;
+		TData data;
+		int32_t parent;
+		int32_t left;
+		int32_t right;
+
+		bool isLeaf() const
+		{
+			return left == null_node;
+		}
+	};
+
+	AABBTree(float margin = 4.0f)
+		: root(null_node)
+		, free_list(null_node)
+		, fat_margin(margin)
+	{}
+
+	int32_t createProxy(const AABB& box, const TData& data)
+	{
+		const int32_t leaf = allocateNode();
+		nodes[leaf].box = box.getExpanded(fat_margin);
+		nodes[leaf].data = data;
+		insertLeaf(leaf);
+		return leaf;
+	}
+
+	void destroyProxy(int32_t proxy)
+	{
+		removeLeaf(proxy);
+		freeNode(proxy);
+	}
+
+	// Returns true if the proxy had to be reinserted
+	bool moveProxy(int32_t proxy, const AABB& box)
+	{
+		if (nodes[proxy].box.contains(box)) {
+			return false;
+		}
+		removeLeaf(proxy);
+		nodes[proxy].box = box.getExpanded(fat_margin);
+		insertLeaf(proxy);
+		return true;
+	}
+
+	const AABB& getFatAABB(int32_t proxy) const
+	{
+		return nodes[proxy].box;
+	}
+
+	// Calls callback(data) for each leaf overlapping box
+	template<typename TCallback>
+	void query(const AABB& box, TCallback&& callback) const
+	{
+		if (root == null_node) {
+			return;
+		}
+		stack.clear();
+		stack.push_back(root);
+		while (!stack.empty()) {
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			if (!node.box.overlaps(box)) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				callback(node.data);
+			}
+			else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	std::vector<Node> nodes;
+	int32_t root;
+	int32_t free_list;
+	float fat_margin;
+
+private:
+	mutable std::vector<int32_t> stack;
+
+	int32_t allocateNode()
+	{
+		int32_t index;
+		if (free_list != null_node) {
+			index = free_list;
+			free_list = nodes[index].parent;
+		}
+		else {
+			index = static_cast<int32_t>(nodes.size());
+			nodes.emplace_back();
+		}
+		nodes[index].parent = null_node;
+		nodes[index].left = null_node;
+		nodes[index].right = null_node;
+		return index;
+	}
+
+	void freeNode(int32_t index)
+	{
+		nodes[index].parent = free_list;
+		free_list = index;
+	}
+
+	float getDescentCost(int32_t child, const AABB& box) const
+	{
+		const AABB merged = box.merge(nodes[child].box);
+		if (nodes[child].isLeaf()) {
+			return merged.getPerimeter();
+		}
+		return merged.getPerimeter() - nodes[child].box.getPerimeter();
+	}
+
+	void insertLeaf(int32_t leaf)
+	{
+		if (root == null_node) {
+			root = leaf;
+			nodes[root].parent = null_node;
+			return;
+		}
+
+		// Find the best sibling using the perimeter as cost
+		const AABB box = nodes[leaf].box;
+		int32_t index = root;
+		while (!nodes[index].isLeaf()) {
+			const float perimeter = nodes[index].box.getPerimeter();
+			const float combined_perimeter = nodes[index].box.merge(box).getPerimeter();
+			const float cost = 2.0f * combined_perimeter;
+			const float inheritance_cost = 2.0f * (combined_perimeter - perimeter);
+			const float cost_left = getDescentCost(nodes[index].left, box) + inheritance_cost;
+			const float cost_right = getDescentCost(nodes[index].right, box) + inheritance_cost;
+			if (cost < cost_left && cost < cost_right) {
+				break;
+			}
+			index = (cost_left < cost_right) ? nodes[index].left : nodes[index].right;
+		}
+
+		const int32_t sibling = index;
+		const int32_t old_parent = nodes[sibling].parent;
+		const int32_t new_parent = allocateNode();
+		nodes[new_parent].parent = old_parent;
+		nodes[new_parent].box = box.merge(nodes[sibling].box);
+		nodes[new_parent].left = sibling;
+		nodes[new_parent].right = leaf;
+		nodes[sibling].parent = new_parent;
+		nodes[leaf].parent = new_parent;
+
+		if (old_parent == null_node) {
+			root = new_parent;
+		}
+		else if (nodes[old_parent].left == sibling) {
+			nodes[old_parent].left = new_parent;
+		}
+		else {
+			nodes[old_parent].right = new_parent;
+		}
+
+		refit(old_parent);
+	}
+
+	void removeLeaf(int32_t leaf)
+	{
+		if (leaf == root) {
+			root = null_node;
+			return;
+		}
+
+		const int32_t parent = nodes[leaf].parent;
+		const int32_t grand_parent = nodes[parent].parent;
+		const int32_t sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+		if (grand_parent == null_node) {
+			root = sibling;
+			nodes[sibling].parent = null_node;
+		}
+		else {
+			if (nodes[grand_parent].left == parent) {
+				nodes[grand_parent].left = sibling;
+			}
+			else {
+				nodes[grand_parent].right = sibling;
+			}
+			nodes[sibling].parent = grand_parent;
+		}
+		freeNode(parent);
+		refit(grand_parent);
+	}
+
+	void refit(int32_t index)
+	{
+		while (index != null_node) {
+			Node& node = nodes[index];
+			node.box = nodes[node.left].box.merge(nodes[node.right].box);
+			index = node.parent;
+		}
+	}
+};
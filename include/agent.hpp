@@ -1,7 +1,11 @@
 #pragma once
 #include <SFML/Graphics.hpp>
+#include <vector>
 #include "grid.hpp"
+#include "flow_field.hpp"
+#include "visibility_cache.hpp"
 #include "sfml_tools.hpp"
+#include "circle_batch.hpp"
 
 
 struct Agent
@@ -19,7 +23,18 @@ struct Agent
 
 	void update(sf::Vector2f& target, Grid& grid, float dt)
 	{
-		if (!grid.castRayToPoint(position, target).hit) {
+		move(target, !grid.castRayToPoint(position, target).hit, dt);
+	}
+
+	void follow(const FlowField& flow_field, float dt)
+	{
+		direction = flow_field.getDirection(position);
+		position += (speed * dt) * direction;
+	}
+
+	void move(const sf::Vector2f& target, bool target_visible, float dt)
+	{
+		if (target_visible) {
 			last_target_position = target;
 
 			direction = Tools::normalize(target - position);
@@ -31,15 +46,11 @@ struct Agent
 		position += (speed * dt) * direction;
 	}
 
-	void draw(sf::RenderTarget& target, const sf::RenderStates& rs) const
+	// Agents are drawn together with the batch's draw call
+	void draw(CircleBatch& batch) const
 	{
 		const float radius = 12.0f;
-		sf::CircleShape c(radius);
-		c.setOrigin(radius, radius);
-		c.setPosition(position);
-		c.setFillColor(sf::Color::Red);
-
-		target.draw(c, rs);
+		batch.add(position, radius, sf::Color::Red);
 	}
 
 	sf::Vector2f position;
@@ -50,3 +61,67 @@ struct Agent
 };
 
 
+// Updates groups of agents at once. Its buffers are kept from one call to the next, so updates don't allocate
+// once they have reached the size of the largest group
+struct AgentsUpdater
+{
+	// Same as Agent::update for all the agents, line of sight checks are done with a single batched cast
+	void update(std::vector<Agent>& agents, const sf::Vector2f& target, const Grid& grid, float dt, ThreadPool* thread_pool = nullptr)
+	{
+		starts.resize(agents.size());
+		targets.assign(agents.size(), target);
+		for (uint64_t i(0); i < agents.size(); ++i) {
+			starts[i] = agents[i].position;
+		}
+		grid.castRays(starts.data(), targets.data(), agents.size(), hits, thread_pool);
+		for (uint64_t i(0); i < agents.size(); ++i) {
+			agents[i].move(target, !hits.hit[i], dt);
+		}
+	}
+
+	// Same as above, rays are only cast for the agents whose cell and target cell are not in the cache
+	void update(std::vector<Agent>& agents, const sf::Vector2f& target, const Grid& grid, VisibilityCache& cache, float dt,
+		        ThreadPool* thread_pool = nullptr)
+	{
+		visible.resize(agents.size());
+		missing.clear();
+		starts.clear();
+		for (uint64_t i(0); i < agents.size(); ++i) {
+			bool cached_visible;
+			if (cache.find(grid, agents[i].position, target, cached_visible)) {
+				visible[i] = cached_visible;
+			}
+			else {
+				missing.push_back(i);
+				starts.push_back(agents[i].position);
+			}
+		}
+		if (!missing.empty()) {
+			targets.assign(missing.size(), target);
+			grid.castRays(starts.data(), targets.data(), missing.size(), hits, thread_pool);
+			for (uint64_t k(0); k < missing.size(); ++k) {
+				visible[missing[k]] = !hits.hit[k];
+				cache.insert(grid, starts[k], target, !hits.hit[k]);
+			}
+		}
+		for (uint64_t i(0); i < agents.size(); ++i) {
+			agents[i].move(target, visible[i], dt);
+		}
+	}
+
+	// Follows a flow field built toward the agents' common target, no ray is cast
+	void update(std::vector<Agent>& agents, const FlowField& flow_field, float dt)
+	{
+		for (Agent& agent : agents) {
+			agent.follow(flow_field, dt);
+		}
+	}
+
+private:
+	std::vector<sf::Vector2f> starts;
+	std::vector<sf::Vector2f> targets;
+	std::vector<uint8_t> visible;
+	// Indices of the agents whose visibility is not in the cache
+	std::vector<uint64_t> missing;
+	RayHits hits;
+};
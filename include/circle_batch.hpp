@@ -0,0 +1,115 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+// Draws any number of circles with a single draw call, each circle is a quad textured with a disc.
+// The vertices are kept between frames and only rewritten in place, the storage never shrinks.
+// They are streamed to a vertex buffer kept on the GPU when available
+struct CircleBatch
+{
+	CircleBatch(uint32_t texture_size = 64)
+		: count(0)
+		, buffer(sf::Quads, sf::VertexBuffer::Stream)
+		, use_buffer(sf::VertexBuffer::isAvailable())
+	{
+		createTexture(texture_size);
+	}
+
+	void resize(uint64_t count_)
+	{
+		if (vertices.size() < 4 * count_) {
+			vertices.resize(4 * count_);
+		}
+		count = count_;
+	}
+
+	uint64_t getSize() const
+	{
+		return count;
+	}
+
+	void clear()
+	{
+		count = 0;
+	}
+
+	void set(uint64_t i, float x, float y, float radius, sf::Color color)
+	{
+		const float size = static_cast<float>(texture.getSize().x);
+		sf::Vertex* quad = &vertices[4 * i];
+		quad[0].position = sf::Vector2f(x - radius, y - radius);
+		quad[1].position = sf::Vector2f(x + radius, y - radius);
+		quad[2].position = sf::Vector2f(x + radius, y + radius);
+		quad[3].position = sf::Vector2f(x - radius, y + radius);
+		quad[0].texCoords = sf::Vector2f(0.0f, 0.0f);
+		quad[1].texCoords = sf::Vector2f(size, 0.0f);
+		quad[2].texCoords = sf::Vector2f(size, size);
+		quad[3].texCoords = sf::Vector2f(0.0f, size);
+		quad[0].color = color;
+		quad[1].color = color;
+		quad[2].color = color;
+		quad[3].color = color;
+	}
+
+	void add(const sf::Vector2f& position, float radius, sf::Color color)
+	{
+		const uint64_t i = getSize();
+		resize(i + 1);
+		set(i, position.x, position.y, radius, color);
+	}
+
+	void draw(sf::RenderTarget& target, sf::RenderStates rs)
+	{
+		if (!count) {
+			return;
+		}
+		rs.texture = &texture;
+		if (use_buffer) {
+			upload();
+		}
+		if (use_buffer) {
+			target.draw(buffer, 0, 4 * count, rs);
+		}
+		else {
+			target.draw(vertices.data(), 4 * count, sf::Quads, rs);
+		}
+	}
+
+private:
+	std::vector<sf::Vertex> vertices;
+	uint64_t count;
+	sf::Texture texture;
+	sf::VertexBuffer buffer;
+	bool use_buffer;
+
+	// The buffer grows with the vertices' storage, only the used vertices are sent
+	void upload()
+	{
+		if (buffer.getVertexCount() < vertices.size()) {
+			use_buffer = buffer.create(vertices.size());
+		}
+		use_buffer = use_buffer && buffer.update(vertices.data(), 4 * count, 0);
+	}
+
+	// White disc with an antialiased border, colors come from the vertices
+	void createTexture(uint32_t size)
+	{
+		sf::Image image;
+		image.create(size, size, sf::Color::Transparent);
+		const float radius = 0.5f * size;
+		for (uint32_t x(0); x < size; ++x) {
+			for (uint32_t y(0); y < size; ++y) {
+				const float dx = x + 0.5f - radius;
+				const float dy = y + 0.5f - radius;
+				const float coverage = std::min(1.0f, std::max(0.0f, radius - std::sqrt(dx * dx + dy * dy)));
+				image.setPixel(x, y, sf::Color(255, 255, 255, static_cast<uint8_t>(255 * coverage)));
+			}
+		}
+		texture.loadFromImage(image);
+		texture.setSmooth(true);
+	}
+};
@@ -27,7 +27,7 @@ struct Constraint
 {
 	virtual bool needCorrection(const Atom& atom) const = 0;
 	virtual const Vec2 getContactPoint(const Atom& atom) const = 0;
-	virtual Impulse getImpulse(const Atom& atom) const = 0;
+	virtual Impulse getImpulse(const Atom& atom, const ComposedObject& parent) const = 0;
 };
 
 
@@ -68,19 +68,19 @@ struct BoundaryConstraint : public Constraint
 		return Vec2(atom.position.x, coord);
 	}
 
-	Impulse getImpulse(const Atom& atom) const override
+	Impulse getImpulse(const Atom& atom, const ComposedObject& parent) const override
 	{
 		const float dt = 0.016f;
 		const Vec2 normal = (type == Type::Horizontal) ? Vec2(direction, 0.0f) : Vec2(0.0f, direction);
 		
-		const float inv_mass = 1.0f / atom.parent->getMass();
-		const float inv_iner = 1.0f / atom.parent->getMomentInertia();
-		const Vec2 to_contact_point = getContactPoint(atom) - atom.parent->center_of_mass;
+		const float inv_mass = 1.0f / parent.getMass();
+		const float inv_iner = 1.0f / parent.getMomentInertia();
+		const Vec2 to_contact_point = getContactPoint(atom) - parent.center_of_mass;
 		const float cross = to_contact_point.cross(normal);
 		//const float cross2 = to_contact_point.getNormalized().cross(normal);
 
 		const float m_eff = 1.0f / (inv_mass + inv_iner * cross * cross);
-		const float c1_d = (atom.parent->velocity).plus(to_contact_point * (atom.parent->angular_velocity)).dot(normal);
+		const float c1_d = (parent.velocity).plus(to_contact_point * (parent.angular_velocity)).dot(normal);
 		//const float c1_d = atom.getVelocity().dot(normal);
 		const float lambda = c1_d * -m_eff;
 
@@ -2,11 +2,13 @@
 
 #include "physic_objects.hpp"
 #include "array.hpp"
+#include <algorithm>
+#include <cmath>
 
 
 struct Utils
 {
-	template<typename T, uint32_t N>
+	template<typename T, uint64_t N>
 	static float dot(const Array<T, N>& v1, const Array<T, N>& v2)
 	{
 		float result = 0.0f;
@@ -17,7 +19,7 @@ struct Utils
 		return result;
 	}
 	
-	template<typename T, uint32_t N>
+	template<typename T, uint64_t N>
 	static Array<T, N> plus(const Array<T, N>& v1, const Array<T, N>& v2)
 	{
 		Array<T, N> result;
@@ -28,7 +30,7 @@ struct Utils
 		return result;
 	}
 
-	template<typename T, uint32_t N>
+	template<typename T, uint64_t N>
 	static void add(Array<T, N>& v1, const Array<T, N>& v2)
 	{
 		for (uint64_t i(0); i < N; ++i) {
@@ -36,7 +38,7 @@ struct Utils
 		}
 	}
 
-	template<typename T, uint32_t N>
+	template<typename T, uint64_t N>
 	static Array<T, N> mult(const Array<T, N>& v1, const Array<T, N>& v2)
 	{
 		Array<T, N> result;
@@ -47,7 +49,7 @@ struct Utils
 		return result;
 	}
 
-	template<typename T, uint32_t N>
+	template<typename T, uint64_t N>
 	static Array<T, N> mult(float f, const Array<T, N>& v)
 	{
 		Array<T, N> result;
@@ -61,13 +63,32 @@ struct Utils
 
 struct AtomContact
 {
+	// Bits of cell_solid_neighbours, set when the cell on that side is solid too
+	enum CellSide : uint8_t {
+		Left = 1,
+		Right = 2,
+		Top = 4,
+		Bottom = 8
+	};
+
 	uint64_t id_a, id_b;
+	// Indices of the atoms' parents in the solver's objects
+	uint32_t body_a, body_b;
+	// Contact between atom id_a and a solid grid cell, id_b is then the cell's index and body_b the grid's static body
+	bool with_cell;
+	uint8_t cell_solid_neighbours;
+	Vec2 cell_min, cell_max;
 
 	float lambda;
 	float accumulated_lambda;
+	float lambda_friction;
+	// Kept from one step to the next to warm start the solver
+	float accumulated_friction;
 	float bias;
+	float normal_mass;
+	float friction_mass;
 	float delta;
-	const float friction = 0.25f;
+	float friction;
 
 	Array<float, 6> j;
 	Array<float, 6> j_friction;
@@ -80,75 +101,144 @@ struct AtomContact
 	mutable float contact_length;
 	mutable Vec2 contact_vec;
 	mutable Vec2 contact_normal;
+	// Point of the cell closest to the atom
+	mutable Vec2 cell_point;
 
 	uint32_t tick_count;
 
 	AtomContact()
 		: id_a(0)
 		, id_b(0)
+		, body_a(0)
+		, body_b(0)
+		, with_cell(false)
+		, cell_solid_neighbours(0)
 		, accumulated_lambda(0.0f)
+		, accumulated_friction(0.0f)
+		, friction(0.25f)
 		, tick_count(0)
 	{}
 
-	AtomContact(uint64_t a, uint64_t b)
+	AtomContact(uint64_t a, uint64_t b, uint32_t body_a_, uint32_t body_b_)
 		: id_a(a)
 		, id_b(b)
+		, body_a(body_a_)
+		, body_b(body_b_)
+		, with_cell(false)
+		, cell_solid_neighbours(0)
 		, accumulated_lambda(0.0f)
+		, accumulated_friction(0.0f)
+		, friction(0.25f)
 		, tick_count(0)
 	{}
 
-	float getDelta(const std::vector<Atom>& atoms) const
+	AtomContact(uint64_t atom, uint32_t body, uint64_t cell, uint32_t grid_body, const Vec2& cell_min_, const Vec2& cell_max_, uint8_t cell_solid_neighbours_)
+		: id_a(atom)
+		, id_b(cell)
+		, body_a(body)
+		, body_b(grid_body)
+		, with_cell(true)
+		, cell_solid_neighbours(cell_solid_neighbours_)
+		, cell_min(cell_min_)
+		, cell_max(cell_max_)
+		, accumulated_lambda(0.0f)
+		, accumulated_friction(0.0f)
+		, friction(0.25f)
+		, tick_count(0)
+	{}
+
+	float getDelta(const AtomStorage& atoms) const
 	{
-		contact_vec = atoms[id_a].position - atoms[id_b].position;
+		if (with_cell) {
+			return getCellDelta(atoms);
+		}
+		contact_vec = Vec2(atoms.x[id_a] - atoms.x[id_b], atoms.y[id_a] - atoms.y[id_b]);
 		contact_length = contact_vec.getLength();
 		contact_normal = contact_vec / contact_length;
-		return contact_length - 2 * atoms[id_a].radius;
+		return contact_length - 2 * atoms.radius[id_a];
+	}
+
+	// Faces shared with a solid neighbour are inside the wall, contacts with them would catch atoms
+	// sliding along it so they are not valid. Atoms with their center in the cell go out by the closest open face
+	float getCellDelta(const AtomStorage& atoms) const
+	{
+		const Vec2 center = atoms.getPosition(id_a);
+		const float radius = atoms.radius[id_a];
+		const float not_valid = 1.0f;
+		cell_point = Vec2(std::max(cell_min.x, std::min(cell_max.x, center.x)), std::max(cell_min.y, std::min(cell_max.y, center.y)));
+		if (cell_point.x != center.x || cell_point.y != center.y) {
+			const uint8_t sides = (center.x < cell_min.x ? Left : 0) | (center.x > cell_max.x ? Right : 0) |
+				                  (center.y < cell_min.y ? Top : 0) | (center.y > cell_max.y ? Bottom : 0);
+			if (sides & cell_solid_neighbours) {
+				return not_valid;
+			}
+			contact_vec = center - cell_point;
+			contact_length = contact_vec.getLength();
+			contact_normal = contact_vec / contact_length;
+			return contact_length - radius;
+		}
+
+		const float distances[4]{ center.x - cell_min.x, cell_max.x - center.x, center.y - cell_min.y, cell_max.y - center.y };
+		const Vec2 normals[4]{ Vec2(-1.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, -1.0f), Vec2(0.0f, 1.0f) };
+		int32_t side = -1;
+		for (int32_t i(0); i < 4; ++i) {
+			if (!(cell_solid_neighbours & (1 << i)) && (side < 0 || distances[i] < distances[side])) {
+				side = i;
+			}
+		}
+		if (side < 0) {
+			return not_valid;
+		}
+		contact_normal = normals[side];
+		cell_point = center.plus(normals[side] * distances[side]);
+		contact_length = 0.0f;
+		contact_vec = Vec2(0.0f, 0.0f);
+		return -distances[side] - radius;
 	}
 
 	// Needs to be done first, initializes contact vecs
-	bool isValid(const std::vector<Atom>& atoms)
+	bool isValid(const AtomStorage& atoms)
 	{
 		delta = getDelta(atoms);
 		return delta < 0.0f;
 	}
 
-	Vec2 getContactPointA(const Vec2& collision_vec, const Atom& atom) const
+	Vec2 getContactPointA(const Vec2& collision_vec, const Vec2& position, float radius) const
 	{
-		return atom.position.minus(collision_vec * atom.radius);
+		return position.minus(collision_vec * radius);
 	}
 
-	Vec2 getContactPointB(const Vec2& collision_vec, const Atom& atom) const
+	Vec2 getContactPointB(const Vec2& collision_vec, const Vec2& position, float radius) const
 	{
-		return atom.position.plus(collision_vec * atom.radius);
+		return position.plus(collision_vec * radius);
 	}
 
-	void initialize(const std::vector<Atom>& atoms)
+	void initialize(const AtomStorage& atoms, const ObjectContainer& objects)
 	{
-		const Atom& atom_a = atoms[id_a];
-		const Atom& atom_b = atoms[id_b];
+		const ComposedObject& parent_a = objects[body_a];
+		const ComposedObject& parent_b = objects[body_b];
 		
 		// Intertia
-		const float inv_mass_a = 1.0f / atom_a.parent->getMass();
-		const float inv_mass_b = 1.0f / atom_b.parent->getMass();
+		const float inv_mass_a = 1.0f / parent_a.getMass();
+		const float inv_mass_b = 1.0f / parent_b.getMass();
 		inv_m[0] = inv_mass_a;
 		inv_m[1] = inv_mass_a;
-		inv_m[2] = 1.0f / atom_a.parent->getMomentInertia();
-		inv_m[3] = inv_mass_b;
-		inv_m[4] = inv_mass_b;
-		inv_m[5] = 1.0f / atom_b.parent->getMomentInertia();
+		inv_m[2] = 1.0f / parent_a.getMomentInertia();
+		// Cells can't move, they act as an infinite mass
+		inv_m[3] = with_cell ? 0.0f : inv_mass_b;
+		inv_m[4] = with_cell ? 0.0f : inv_mass_b;
+		inv_m[5] = with_cell ? 0.0f : 1.0f / parent_b.getMomentInertia();
 
 		// Jacobians
-		initialize_jacobians(atoms);
+		initialize_jacobians(atoms, objects);
 	}
 
-	void initialize_jacobians(const std::vector<Atom>& atoms)
+	void initialize_jacobians(const AtomStorage& atoms, const ObjectContainer& objects)
 	{
-		const Atom& atom_a = atoms[id_a];
-		const Atom& atom_b = atoms[id_b];
-
-		contact_point = getContactPointA(contact_normal, atom_a);
-		const Vec2 to_contact_point_a = contact_point - atom_a.parent->center_of_mass;
-		const Vec2 to_contact_point_b = getContactPointB(contact_normal, atom_b) - atom_b.parent->center_of_mass;
+		contact_point = getContactPointA(contact_normal, atoms.getPosition(id_a), atoms.radius[id_a]);
+		const Vec2 to_contact_point_a = contact_point - objects[body_a].center_of_mass;
+		const Vec2 contact_point_b = with_cell ? cell_point : getContactPointB(contact_normal, atoms.getPosition(id_b), atoms.radius[id_b]);
+		const Vec2 to_contact_point_b = contact_point_b - objects[body_b].center_of_mass;
 		// Normal
 		j[0] = contact_normal.x;
 		j[1] = contact_normal.y;
@@ -165,48 +255,53 @@ struct AtomContact
 		j_friction[4] = -contact_tangent.y;
 		j_friction[5] = -to_contact_point_b.cross(contact_tangent);
 
+		// Effective masses only change with the jacobians
+		normal_mass = 1.0f / Utils::dot(j, Utils::mult(inv_m, j));
+		friction_mass = 1.0f / Utils::dot(j_friction, Utils::mult(inv_m, j_friction));
+
 		const float c = Vec2(0.0f, delta).dot(contact_normal);
 		bias = 0.2f / 0.016f * ((c < 0.0f) ? c : 0.0f);
-		accumulated_lambda = 0.0f;
 	}
 
-	void applyImpulse(Atom& atom_a, Atom& atom_b, const Array<float, 6>& impulse_vec)
+	void applyImpulse(ComposedObject& parent_a, ComposedObject& parent_b, const Array<float, 6>& impulse_vec)
 	{
-		atom_a.parent->velocity = Vec2(impulse_vec[0], impulse_vec[1]);
-		atom_a.parent->angular_velocity = impulse_vec[2];
-		atom_b.parent->velocity = Vec2(impulse_vec[3], impulse_vec[4]);
-		atom_b.parent->angular_velocity = impulse_vec[5];
+		// Static bodies can be shared by contacts solved in parallel, they are never written
+		if (parent_a.moving) {
+			parent_a.velocity = Vec2(impulse_vec[0], impulse_vec[1]);
+			parent_a.angular_velocity = impulse_vec[2];
+		}
+		if (parent_b.moving) {
+			parent_b.velocity = Vec2(impulse_vec[3], impulse_vec[4]);
+			parent_b.angular_velocity = impulse_vec[5];
+		}
 	}
 
-	void applyImpulse(std::vector<Atom>& atoms, const Array<float, 6>& impulse_vec)
+	void applyImpulse(ObjectContainer& objects, const Array<float, 6>& impulse_vec)
 	{
-		Atom& atom_a = atoms[id_a];
-		Atom& atom_b = atoms[id_b];
-
-		applyImpulse(atom_a, atom_b, impulse_vec);
+		applyImpulse(objects[body_a], objects[body_b], impulse_vec);
 	}
 
-	void applyLastImpulse(std::vector<Atom>& atoms)
+	// Applies the impulses accumulated during the last step, the solver then only has to correct them
+	void warmStart(ObjectContainer& objects)
 	{
 		++tick_count;
 
-		Atom& atom_a = atoms[id_a];
-		Atom& atom_b = atoms[id_b];
+		ComposedObject& parent_a = objects[body_a];
+		ComposedObject& parent_b = objects[body_b];
 
-		const Vec2 body_1_velocity = atom_a.parent->getVelocity();
-		const Vec2 body_2_velocity = atom_b.parent->getVelocity();
+		const Vec2 body_1_velocity = parent_a.getVelocity();
+		const Vec2 body_2_velocity = parent_b.getVelocity();
 
 		Array<float, 6> v_tmp = {
 			body_1_velocity.x,
 			body_1_velocity.y,
-			atom_a.parent->getAngularVelocity(),
+			parent_a.getAngularVelocity(),
 			body_2_velocity.x,
 			body_2_velocity.y,
-			atom_b.parent->getAngularVelocity()
+			parent_b.getAngularVelocity()
 		};
-		addToAccumulatedLambda();
-		Utils::add(v_tmp, Utils::mult(inv_m, Utils::mult(lambda, j)));
-		applyImpulse(atom_a, atom_b, v_tmp);
+		Utils::add(v_tmp, Utils::mult(inv_m, Utils::plus(Utils::mult(accumulated_lambda, j), Utils::mult(accumulated_friction, j_friction))));
+		applyImpulse(parent_a, parent_b, v_tmp);
 	}
 
 	void addToAccumulatedLambda()
@@ -217,39 +312,46 @@ struct AtomContact
 		accumulated_lambda += lambda;
 	}
 
-	void computeImpulse(std::vector<Atom>& atoms)
+	// Total friction stays within the friction cone of the total normal impulse
+	void addToAccumulatedFriction()
 	{
-		Atom& atom_a = atoms[id_a];
-		Atom& atom_b = atoms[id_b];
+		const float max_friction = friction * accumulated_lambda;
+		const float new_accumulated_friction = std::max(-max_friction, std::min(max_friction, accumulated_friction + lambda_friction));
+		lambda_friction = new_accumulated_friction - accumulated_friction;
+		accumulated_friction = new_accumulated_friction;
+	}
 
-		const Vec2 body_1_velocity = atom_a.parent->getVelocity();
-		const Vec2 body_2_velocity = atom_b.parent->getVelocity();
+	// Returns the biggest impulse change, the solver has converged when it gets close to 0
+	float computeImpulse(ObjectContainer& objects)
+	{
+		ComposedObject& parent_a = objects[body_a];
+		ComposedObject& parent_b = objects[body_b];
+
+		const Vec2 body_1_velocity = parent_a.getVelocity();
+		const Vec2 body_2_velocity = parent_b.getVelocity();
 		v = {
 			body_1_velocity.x,
 			body_1_velocity.y,
-			atom_a.parent->getAngularVelocity(),
+			parent_a.getAngularVelocity(),
 			body_2_velocity.x,
 			body_2_velocity.y,
-			atom_b.parent->getAngularVelocity()
+			parent_b.getAngularVelocity()
 		};
 
 		// Normal
-		lambda = -(Utils::dot(j, v) + bias) / Utils::dot(j, Utils::mult(inv_m, j));
+		lambda = -(Utils::dot(j, v) + bias) * normal_mass;
 		addToAccumulatedLambda();
-		impulse = contact_normal * lambda;
+		impulse = contact_normal * accumulated_lambda;
 		Utils::add(v, Utils::mult(inv_m, Utils::mult(lambda, j)));
-		applyImpulse(atom_a, atom_b, v);
+		applyImpulse(parent_a, parent_b, v);
 
 		// Friction
-		float lambda_friction = -Utils::dot(j_friction, v) / Utils::dot(j_friction, Utils::mult(inv_m, j_friction));
-		if (lambda_friction > friction * lambda) {
-			lambda_friction = friction * lambda;
-		}
-		else if (lambda_friction < -friction * lambda) {
-			lambda_friction = -friction * lambda;
-		}
+		lambda_friction = -Utils::dot(j_friction, v) * friction_mass;
+		addToAccumulatedFriction();
 
 		Utils::add(v, Utils::mult(inv_m, Utils::mult(lambda_friction, j_friction)));
-		applyImpulse(atom_a, atom_b, v);
+		applyImpulse(parent_a, parent_b, v);
+
+		return std::max(std::abs(lambda), std::abs(lambda_friction));
 	}
-};
+};
\ No newline at end of file
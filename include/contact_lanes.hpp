@@ -0,0 +1,189 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "contact.hpp"
+#include "iterations.hpp"
+#include "lanes.hpp"
+
+
+// Structure of arrays batch of contacts that share no moving body, solved together
+template<uint32_t N>
+struct ContactLanes
+{
+	float j[6][N];
+	float j_friction[6][N];
+	float inv_m[6][N];
+	float normal_mass[N];
+	float friction_mass[N];
+	float bias[N];
+	float friction[N];
+	float accumulated_lambda[N];
+	float lambda[N];
+	float accumulated_friction[N];
+	float lambda_friction[N];
+	// -1 for static bodies and padding lanes
+	int32_t body_a[N];
+	int32_t body_b[N];
+	AtomContact* contacts[N];
+};
+
+
+#ifdef HORD_LANES_X86
+#define HORD_LANES LanesSSE
+#define HORD_LANES_TARGET
+#include "contact_lanes_kernel.hpp"
+#undef HORD_LANES
+#undef HORD_LANES_TARGET
+
+#define HORD_LANES LanesAVX
+#define HORD_LANES_TARGET HORD_TARGET_AVX
+#include "contact_lanes_kernel.hpp"
+#undef HORD_LANES
+#undef HORD_LANES_TARGET
+#endif
+
+
+// Solves colored contacts by batches of 4 (SSE) or 8 (AVX) lanes. Lanes of a batch come from
+// the same color so the result is the same as solving them one after the other.
+// Falls back to SSE without AVX and to the scalar solver on other architectures
+struct ContactLanesSolver
+{
+	ContactLanesSolver()
+		: allow_avx(true)
+	{}
+
+	ConvergenceStats solve(AtomContact* const* contacts, const uint32_t* colors_offsets, uint32_t colors_count,
+		                   uint32_t sequential_color, ObjectContainer& objects, const IterationsSettings& settings)
+	{
+#ifdef HORD_LANES_X86
+		if (allow_avx && hasAVXSupport()) {
+			return solve<LanesAVX>(lanes_avx, contacts, colors_offsets, colors_count, sequential_color, objects, settings);
+		}
+		return solve<LanesSSE>(lanes_sse, contacts, colors_offsets, colors_count, sequential_color, objects, settings);
+#else
+		ConvergenceStats stats;
+		const uint32_t max_iterations_count = settings.getMaxIterationsCount();
+		for (uint32_t i(0); i < max_iterations_count; ++i) {
+			float residual = 0.0f;
+			for (uint32_t c(0); c < colors_offsets[colors_count]; ++c) {
+				residual = std::max(residual, contacts[c]->computeImpulse(objects));
+			}
+			stats.iterations_count = i + 1;
+			stats.residual = residual;
+			if (settings.isConverged(i + 1, residual)) {
+				break;
+			}
+		}
+		return stats;
+#endif
+	}
+
+	bool allow_avx;
+
+private:
+	std::vector<ContactLanes<4>> lanes_sse;
+	std::vector<ContactLanes<8>> lanes_avx;
+	std::vector<float> velocities;
+
+	template<typename TLanes, typename TBatch>
+	ConvergenceStats solve(std::vector<TBatch>& batches, AtomContact* const* contacts, const uint32_t* colors_offsets, uint32_t colors_count,
+		                   uint32_t sequential_color, ObjectContainer& objects, const IterationsSettings& settings)
+	{
+		const uint32_t width = TLanes::width;
+		batches.clear();
+		for (uint32_t color(0); color < colors_count; ++color) {
+			// Contacts of this color may share bodies, they get a batch each
+			const uint32_t batch_size = (color == sequential_color) ? 1 : width;
+			for (uint32_t c(colors_offsets[color]); c < colors_offsets[color + 1]; c += batch_size) {
+				batches.emplace_back();
+				pack(batches.back(), contacts, c, std::min(c + batch_size, colors_offsets[color + 1]), objects);
+			}
+		}
+
+		velocities.resize(3 * objects.size());
+		for (uint64_t i(0); i < objects.size(); ++i) {
+			velocities[3 * i + 0] = objects[i].velocity.x;
+			velocities[3 * i + 1] = objects[i].velocity.y;
+			velocities[3 * i + 2] = objects[i].angular_velocity;
+		}
+
+		ConvergenceStats stats;
+		const uint32_t max_iterations_count = settings.getMaxIterationsCount();
+		for (uint32_t i(0); i < max_iterations_count; ++i) {
+			float residual = 0.0f;
+			for (TBatch& batch : batches) {
+				residual = std::max(residual, solveContactLanes(TLanes(), batch, velocities.data()));
+			}
+			stats.iterations_count = i + 1;
+			stats.residual = residual;
+			if (settings.isConverged(i + 1, residual)) {
+				break;
+			}
+		}
+
+		for (uint64_t i(0); i < objects.size(); ++i) {
+			if (objects[i].moving) {
+				objects[i].velocity = Vec2(velocities[3 * i + 0], velocities[3 * i + 1]);
+				objects[i].angular_velocity = velocities[3 * i + 2];
+			}
+		}
+
+		for (const TBatch& batch : batches) {
+			for (uint32_t l(0); l < width; ++l) {
+				AtomContact* contact = batch.contacts[l];
+				if (contact) {
+					contact->lambda = batch.lambda[l];
+					contact->accumulated_lambda = batch.accumulated_lambda[l];
+					contact->lambda_friction = batch.lambda_friction[l];
+					contact->accumulated_friction = batch.accumulated_friction[l];
+					contact->impulse = contact->contact_normal * batch.accumulated_lambda[l];
+				}
+			}
+		}
+		return stats;
+	}
+
+	template<uint32_t N>
+	static void pack(ContactLanes<N>& batch, AtomContact* const* contacts, uint32_t begin, uint32_t end, const ObjectContainer& objects)
+	{
+		for (uint32_t l(0); l < N; ++l) {
+			AtomContact* contact = (begin + l < end) ? contacts[begin + l] : nullptr;
+			batch.contacts[l] = contact;
+			if (!contact) {
+				// Padding lanes produce null impulses
+				for (uint32_t k(0); k < 6; ++k) {
+					batch.j[k][l] = 0.0f;
+					batch.j_friction[k][l] = 0.0f;
+					batch.inv_m[k][l] = 0.0f;
+				}
+				batch.normal_mass[l] = 0.0f;
+				batch.friction_mass[l] = 0.0f;
+				batch.bias[l] = 0.0f;
+				batch.friction[l] = 0.0f;
+				batch.accumulated_lambda[l] = 0.0f;
+				batch.lambda[l] = 0.0f;
+				batch.accumulated_friction[l] = 0.0f;
+				batch.lambda_friction[l] = 0.0f;
+				batch.body_a[l] = -1;
+				batch.body_b[l] = -1;
+				continue;
+			}
+			for (uint32_t k(0); k < 6; ++k) {
+				batch.j[k][l] = contact->j[k];
+				batch.j_friction[k][l] = contact->j_friction[k];
+				batch.inv_m[k][l] = contact->inv_m[k];
+			}
+			batch.normal_mass[l] = contact->normal_mass;
+			batch.friction_mass[l] = contact->friction_mass;
+			batch.bias[l] = contact->bias;
+			batch.friction[l] = contact->friction;
+			batch.accumulated_lambda[l] = contact->accumulated_lambda;
+			batch.lambda[l] = contact->lambda;
+			batch.accumulated_friction[l] = contact->accumulated_friction;
+			batch.lambda_friction[l] = contact->lambda_friction;
+			batch.body_a[l] = objects[contact->body_a].moving ? static_cast<int32_t>(contact->body_a) : -1;
+			batch.body_b[l] = objects[contact->body_b].moving ? static_cast<int32_t>(contact->body_b) : -1;
+		}
+	}
+};
@@ -0,0 +1,89 @@
+// No include guard, this is included by contact_lanes.hpp once per instruction set with
+// HORD_LANES set to the lanes operations and HORD_LANES_TARGET to the matching function attribute.
+// Same math as AtomContact::computeImpulse, for HORD_LANES::width contacts at once
+
+
+HORD_LANES_TARGET inline float solveContactLanes(HORD_LANES, ContactLanes<HORD_LANES::width>& lanes, float* velocities)
+{
+	typedef HORD_LANES L;
+	typedef L::Type V;
+	const uint32_t width = L::width;
+
+	float gathered[6][width];
+	for (uint32_t l(0); l < width; ++l) {
+		const int32_t a = lanes.body_a[l];
+		const int32_t b = lanes.body_b[l];
+		for (uint32_t k(0); k < 3; ++k) {
+			gathered[k][l] = (a < 0) ? 0.0f : velocities[3 * a + k];
+			gathered[k + 3][l] = (b < 0) ? 0.0f : velocities[3 * b + k];
+		}
+	}
+
+	const V zero = L::zero();
+	V v[6], j[6], inv_m[6];
+	for (uint32_t k(0); k < 6; ++k) {
+		v[k] = L::load(gathered[k]);
+		j[k] = L::load(lanes.j[k]);
+		inv_m[k] = L::load(lanes.inv_m[k]);
+	}
+
+	// Normal
+	V jv = zero;
+	for (uint32_t k(0); k < 6; ++k) {
+		jv = L::add(jv, L::mul(j[k], v[k]));
+	}
+	V lambda = L::sub(zero, L::mul(L::add(jv, L::load(lanes.bias)), L::load(lanes.normal_mass)));
+	V accumulated_lambda = L::load(lanes.accumulated_lambda);
+	lambda = L::select(L::less(L::add(accumulated_lambda, lambda), zero), L::sub(zero, accumulated_lambda), lambda);
+	accumulated_lambda = L::add(accumulated_lambda, lambda);
+	L::store(lanes.accumulated_lambda, accumulated_lambda);
+	L::store(lanes.lambda, lambda);
+	for (uint32_t k(0); k < 6; ++k) {
+		v[k] = L::add(v[k], L::mul(inv_m[k], L::mul(lambda, j[k])));
+	}
+
+	// Friction
+	V j_friction[6];
+	V jv_friction = zero;
+	for (uint32_t k(0); k < 6; ++k) {
+		j_friction[k] = L::load(lanes.j_friction[k]);
+		jv_friction = L::add(jv_friction, L::mul(j_friction[k], v[k]));
+	}
+	V lambda_friction = L::mul(L::sub(zero, jv_friction), L::load(lanes.friction_mass));
+	const V accumulated_friction = L::load(lanes.accumulated_friction);
+	const V max_friction = L::mul(L::load(lanes.friction), accumulated_lambda);
+	const V min_friction = L::sub(zero, max_friction);
+	V new_accumulated_friction = L::add(accumulated_friction, lambda_friction);
+	new_accumulated_friction = L::select(L::less(max_friction, new_accumulated_friction), max_friction,
+	                           L::select(L::less(new_accumulated_friction, min_friction), min_friction, new_accumulated_friction));
+	lambda_friction = L::sub(new_accumulated_friction, accumulated_friction);
+	L::store(lanes.accumulated_friction, new_accumulated_friction);
+	L::store(lanes.lambda_friction, lambda_friction);
+	for (uint32_t k(0); k < 6; ++k) {
+		v[k] = L::add(v[k], L::mul(inv_m[k], L::mul(lambda_friction, j_friction[k])));
+		L::store(gathered[k], v[k]);
+	}
+
+	// Static bodies and padding lanes have no body to write to
+	for (uint32_t l(0); l < width; ++l) {
+		const int32_t a = lanes.body_a[l];
+		const int32_t b = lanes.body_b[l];
+		for (uint32_t k(0); k < 3; ++k) {
+			if (a >= 0) {
+				velocities[3 * a + k] = gathered[k][l];
+			}
+			if (b >= 0) {
+				velocities[3 * b + k] = gathered[k + 3][l];
+			}
+		}
+	}
+
+	// Biggest impulse change among the lanes, padding lanes don't change anything
+	float residuals[width];
+	L::store(residuals, L::max(L::abs(lambda), L::abs(lambda_friction)));
+	float residual = 0.0f;
+	for (uint32_t l(0); l < width; ++l) {
+		residual = std::max(residual, residuals[l]);
+	}
+	return residual;
+}
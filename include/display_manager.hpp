@@ -33,6 +33,8 @@ public:
     float getZoom() const {return m_zoom;};
 	sf::Vector2f worldCoordToDisplayCoord(const sf::Vector2f&) const;
 	sf::Vector2f displayCoordToWorldCoord(const sf::Vector2f&) const;
+	// part of the world currently on screen
+	sf::FloatRect getVisibleWorldRect() const;
 
 	bool clic;
 	bool pause;
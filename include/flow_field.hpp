@@ -0,0 +1,160 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <SFML/System/Vector2.hpp>
+#include "grid.hpp"
+#include "sfml_tools.hpp"
+
+
+// Direction toward a target from every cell of a grid, shared by all the agents chasing that target.
+// Built with a breadth first search from the target's cell, only when the target changes cell or the grid changes
+struct FlowField
+{
+	static constexpr uint32_t unreachable = std::numeric_limits<uint32_t>::max();
+
+	FlowField()
+		: width(0)
+		, height(0)
+		, cell_size(1)
+		, target_cell(-1, -1)
+		, grid_version(std::numeric_limits<uint64_t>::max())
+	{}
+
+	// Returns true if the field was recomputed
+	bool update(const Grid& grid, const sf::Vector2f& target_)
+	{
+		const GridInfo info = grid.getInfo();
+		const sf::Vector2i new_target_cell(Tools::as<int32_t>(target_.x / info.cell_size), Tools::as<int32_t>(target_.y / info.cell_size));
+		target = target_;
+		if (new_target_cell == target_cell && grid.getVersion() == grid_version && info.width == width && info.height == height) {
+			return false;
+		}
+
+		width = info.width;
+		height = info.height;
+		cell_size = info.cell_size;
+		target_cell = new_target_cell;
+		grid_version = grid.getVersion();
+		computeDistances(grid);
+		computeDirections();
+		return true;
+	}
+
+	// Unit vector to follow from the position, straight to the target in its cell and null where it can't be reached
+	sf::Vector2f getDirection(const sf::Vector2f& position) const
+	{
+		const int32_t x = Tools::as<int32_t>(position.x / cell_size);
+		const int32_t y = Tools::as<int32_t>(position.y / cell_size);
+		if (x == target_cell.x && y == target_cell.y) {
+			const sf::Vector2f to_target = target - position;
+			return (to_target.x || to_target.y) ? Tools::normalize(to_target) : sf::Vector2f(0.0f, 0.0f);
+		}
+		if (!checkCoords(x, y)) {
+			return sf::Vector2f(0.0f, 0.0f);
+		}
+		return getNeighbourDirection(directions[getIndex(x, y)]);
+	}
+
+	// Number of cells to cross to reach the target, 4-connected, unreachable for walls and closed areas
+	uint32_t getDistance(int32_t x, int32_t y) const
+	{
+		return checkCoords(x, y) ? distances[getIndex(x, y)] : unreachable;
+	}
+
+private:
+	static constexpr uint8_t no_direction = 8;
+
+	int32_t width;
+	int32_t height;
+	int32_t cell_size;
+	sf::Vector2f target;
+	sf::Vector2i target_cell;
+	uint64_t grid_version;
+
+	std::vector<uint32_t> distances;
+	// Index of the neighbour to go to, no_direction if there is none
+	std::vector<uint8_t> directions;
+	std::vector<uint32_t> queue;
+
+	// Orthogonal neighbours first
+	static const int32_t* getNeighbourOffset(uint32_t i)
+	{
+		static const int32_t offsets[8][2]{ {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1} };
+		return offsets[i];
+	}
+
+	static sf::Vector2f getNeighbourDirection(uint8_t i)
+	{
+		if (i == no_direction) {
+			return sf::Vector2f(0.0f, 0.0f);
+		}
+		const float diagonal = 0.70710678f;
+		static const sf::Vector2f unit_directions[8]{ {1.0f, 0.0f}, {-1.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, -1.0f},
+			                                          {diagonal, diagonal}, {-diagonal, diagonal}, {diagonal, -diagonal}, {-diagonal, -diagonal} };
+		return unit_directions[i];
+	}
+
+	void computeDistances(const Grid& grid)
+	{
+		const uint64_t cells_count = Tools::as<uint64_t>(width) * Tools::as<uint64_t>(height);
+		distances.assign(cells_count, unreachable);
+		queue.clear();
+		if (!checkCoords(target_cell.x, target_cell.y) || grid.getCellContentAt(target_cell.x, target_cell.y) == 1) {
+			return;
+		}
+
+		queue.push_back(Tools::as<uint32_t>(getIndex(target_cell.x, target_cell.y)));
+		distances[queue.back()] = 0;
+		for (uint64_t i(0); i < queue.size(); ++i) {
+			const uint32_t index = queue[i];
+			const int32_t x = Tools::as<int32_t>(index % width);
+			const int32_t y = Tools::as<int32_t>(index / width);
+			for (uint32_t n(0); n < 4; ++n) {
+				const int32_t nx = x + getNeighbourOffset(n)[0];
+				const int32_t ny = y + getNeighbourOffset(n)[1];
+				if (!checkCoords(nx, ny)) {
+					continue;
+				}
+				const uint64_t neighbour = getIndex(nx, ny);
+				if (distances[neighbour] == unreachable && grid.getCellContentAt(nx, ny) != 1) {
+					distances[neighbour] = distances[index] + 1;
+					queue.push_back(Tools::as<uint32_t>(neighbour));
+				}
+			}
+		}
+	}
+
+	// Each cell points to its closest neighbour to the target, diagonals only when they don't cut a wall's corner
+	void computeDirections()
+	{
+		directions.assign(distances.size(), no_direction);
+		for (const uint32_t index : queue) {
+			const int32_t x = Tools::as<int32_t>(index % width);
+			const int32_t y = Tools::as<int32_t>(index / width);
+			uint32_t best_distance = distances[index];
+			for (uint32_t n(0); n < 8; ++n) {
+				const int32_t* offset = getNeighbourOffset(n);
+				const uint32_t distance = getDistance(x + offset[0], y + offset[1]);
+				if (distance >= best_distance) {
+					continue;
+				}
+				if (n >= 4 && (getDistance(x + offset[0], y) == unreachable || getDistance(x, y + offset[1]) == unreachable)) {
+					continue;
+				}
+				best_distance = distance;
+				directions[index] = Tools::as<uint8_t>(n);
+			}
+		}
+	}
+
+	uint64_t getIndex(int32_t x, int32_t y) const
+	{
+		return Tools::as<uint64_t>(x) + Tools::as<uint64_t>(y) * Tools::as<uint64_t>(width);
+	}
+
+	bool checkCoords(int32_t x, int32_t y) const
+	{
+		return (x >= 0 && y >= 0 && x < width && y < height);
+	}
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+
+// View on an array allocated from a FrameArena, only valid until the arena is reset
+template<typename T>
+struct ArenaArray
+{
+	ArenaArray()
+		: data(nullptr)
+		, count(0)
+	{}
+
+	ArenaArray(T* data_, uint32_t count_)
+		: data(data_)
+		, count(count_)
+	{}
+
+	T& operator[](uint64_t i)
+	{
+		return data[i];
+	}
+
+	const T& operator[](uint64_t i) const
+	{
+		return data[i];
+	}
+
+	uint32_t size() const
+	{
+		return count;
+	}
+
+	T* begin() const
+	{
+		return data;
+	}
+
+	T* end() const
+	{
+		return data + count;
+	}
+
+	T* data;
+	uint32_t count;
+};
+
+
+// Bump allocator for data that only lives during one step. If a step needs more than the block,
+// extra blocks are allocated and the block is grown to fit on the next reset
+struct FrameArena
+{
+	FrameArena(uint64_t capacity_ = 1 << 16)
+		: capacity(capacity_)
+		, offset(0)
+		, overflow_size(0)
+		, block(new uint8_t[capacity_])
+	{}
+
+	// Content is left uninitialized
+	template<typename T>
+	ArenaArray<T> allocate(uint32_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Arena memory is never destroyed");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Unsupported alignment");
+		const uint64_t size = count * sizeof(T);
+		const uint64_t aligned_offset = (offset + alignof(T) - 1) & ~static_cast<uint64_t>(alignof(T) - 1);
+		if (aligned_offset + size <= capacity) {
+			offset = aligned_offset + size;
+			return ArenaArray<T>(reinterpret_cast<T*>(block.get() + aligned_offset), count);
+		}
+		overflow_blocks.emplace_back(new uint8_t[size ? size : 1]);
+		overflow_size += size + alignof(std::max_align_t);
+		return ArenaArray<T>(reinterpret_cast<T*>(overflow_blocks.back().get()), count);
+	}
+
+	template<typename T>
+	ArenaArray<T> allocate(uint32_t count, const T& value)
+	{
+		ArenaArray<T> result = allocate<T>(count);
+		std::fill(result.begin(), result.end(), value);
+		return result;
+	}
+
+	void reset()
+	{
+		if (!overflow_blocks.empty()) {
+			capacity = std::max(2 * capacity, offset + overflow_size);
+			block.reset(new uint8_t[capacity]);
+			overflow_blocks.clear();
+			overflow_size = 0;
+		}
+		offset = 0;
+	}
+
+	uint64_t getCapacity() const
+	{
+		return capacity;
+	}
+
+private:
+	uint64_t capacity;
+	uint64_t offset;
+	uint64_t overflow_size;
+	std::unique_ptr<uint8_t[]> block;
+	std::vector<std::unique_ptr<uint8_t[]>> overflow_blocks;
+};
@@ -4,17 +4,64 @@
 #include <sfml_tools.hpp>
 #include <iostream>
 #include <array>
+#include <algorithm>
+#include <limits>
+#include <cstring>
 #include "vec.hpp"
-#include "physic.hpp"
+#include "grid_occupancy.hpp"
+#include "grid_chunks.hpp"
+#include "thread_pool.hpp"
 
 
 struct HitPoint
 {
 	HitPoint(bool hit_)
 		: hit(hit_)
+		, distance(0.0f)
+		, cell_x(-1)
+		, cell_y(-1)
+	{}
+
+	HitPoint(bool hit_, float distance_, int32_t cell_x_, int32_t cell_y_)
+		: hit(hit_)
+		, distance(distance_)
+		, cell_x(cell_x_)
+		, cell_y(cell_y_)
 	{}
 
 	bool hit;
+	// Distance to the hit cell's border, the ray's length if nothing was hit
+	float distance;
+	// -1 if nothing was hit
+	int32_t cell_x, cell_y;
+};
+
+
+// Results of a batch of rays, as separate arrays
+struct RayHits
+{
+	void resize(uint64_t count)
+	{
+		hit.resize(count);
+		distance.resize(count);
+		cell_x.resize(count);
+		cell_y.resize(count);
+	}
+
+	uint64_t size() const
+	{
+		return hit.size();
+	}
+
+	HitPoint get(uint64_t i) const
+	{
+		return HitPoint(hit[i] != 0, distance[i], cell_x[i], cell_y[i]);
+	}
+
+	std::vector<uint8_t> hit;
+	std::vector<float> distance;
+	std::vector<int32_t> cell_x;
+	std::vector<int32_t> cell_y;
 };
 
 
@@ -31,55 +78,124 @@ struct GridInfo
 };
 
 
-struct Cell
+// Inclusive range of cells
+struct GridRegion
 {
-	uint8_t count;
-	uint8_t type;
-	std::array<Atom, 10> objects;
+	GridRegion()
+		: min_x(1)
+		, min_y(1)
+		, max_x(0)
+		, max_y(0)
+	{}
+
+	bool isEmpty() const
+	{
+		return max_x < min_x;
+	}
+
+	void add(int32_t x, int32_t y)
+	{
+		if (isEmpty()) {
+			min_x = max_x = x;
+			min_y = max_y = y;
+			return;
+		}
+		min_x = std::min(min_x, x);
+		min_y = std::min(min_y, y);
+		max_x = std::max(max_x, x);
+		max_y = std::max(max_y, y);
+	}
+
+	int32_t min_x, min_y;
+	int32_t max_x, max_y;
 };
 
 
 struct Grid
 {
 public:
-	Grid(int32_t cell_size_, int32_t width_, int32_t height_)
+	enum class Storage {
+		// One byte per cell
+		Dense = 0,
+		// One bit per cell in chunks, uniform chunks take no memory. Only keeps solid (1) and empty cells
+		Chunked = 1
+	};
+
+	Grid(int32_t cell_size_, int32_t width_, int32_t height_, Storage storage_ = Storage::Dense)
 		: cell_size(cell_size_)
 		, width(width_)
 		, height(height_)
-		, data(Tools::as<uint64_t>(width) * Tools::as<uint64_t>(height), 0u)
-	{}
+		, storage(storage_)
+		, data((storage == Storage::Dense) ? Tools::as<uint64_t>(width) * Tools::as<uint64_t>(height) : 0u, 0u)
+		, rows_versions(Tools::as<uint64_t>(height), 0)
+		, version(0)
+	{
+		if (storage == Storage::Dense) {
+			occupancy.resize(width, height);
+		}
+		else {
+			chunks.resize(width, height);
+		}
+	}
 
-	HitPoint castRayToPoint(const sf::Vector2f& start, const sf::Vector2f& end)
+	HitPoint castRayToPoint(const sf::Vector2f& start, const sf::Vector2f& end) const
 	{
 		return castRay(start, Tools::normalize(end - start), Tools::length(end - start));
 	}
 
-	HitPoint castRay(const sf::Vector2f& start, const sf::Vector2f& direction, const float max_dist)
+	HitPoint castRay(const sf::Vector2f& start, const sf::Vector2f& direction, const float max_dist) const
 	{
-		int32_t cell_coords[2];
-		toGridCoords(start, cell_coords);
-		const int32_t step[]{ Tools::as<int32_t>(Tools::sign(direction.x)), Tools::as<int32_t>(Tools::sign(direction.y)) };
-		const float cell_size_f = Tools::as<float>(cell_size);
-		const float inv_direction[]{ 1.0f / direction.x, 1.0f / direction.y };
-		const float t_d[]{ std::abs(cell_size_f * inv_direction[0]), std::abs(cell_size_f * inv_direction[1]) };
+		GridRay ray = initRay(start, direction);
+		if (storage == Storage::Chunked) {
+			return castRayChunked(ray, max_dist);
+		}
 
-		float t_max[]{
-			((cell_coords[0] + (step[0] > 0)) * cell_size_f - start.x) * inv_direction[0],
-			((cell_coords[1] + (step[1] > 0)) * cell_size_f - start.y) * inv_direction[1]
-		};
+		float distance = 0.0f;
+		while (true) {
+			const uint32_t axis = ray.getNextAxis();
+			const float t_next = ray.getNextTime(axis);
+			if (!(t_next < max_dist)) {
+				break;
+			}
 
-		uint32_t min_index = (t_max[0] >= t_max[1]);
-		while (t_max[min_index] < max_dist) {
-			if (getCellContentAt(cell_coords[0], cell_coords[1]) == 1) {
-				return HitPoint(true);
+			if (checkCoords(ray.cell[0], ray.cell[1])) {
+				const int32_t empty_block_size = occupancy.getEmptyBlockSize(ray.cell[0], ray.cell[1]);
+				if (empty_block_size) {
+					if (!ray.crossBlock(empty_block_size, max_dist, distance)) {
+						break;
+					}
+					continue;
+				}
+				if (data[getIndexFromCoords(ray.cell[0], ray.cell[1])] == 1) {
+					return HitPoint(true, distance, ray.cell[0], ray.cell[1]);
+				}
 			}
 
-			t_max[min_index] += t_d[min_index];
-			cell_coords[min_index] += step[min_index];
-			min_index = (t_max[0] >= t_max[1]);
+			distance = t_next;
+			ray.advance(axis, 1);
 		}
 
-		return HitPoint(false);
+		return HitPoint(false, max_dist, -1, -1);
+	}
+
+	// Same as castRayToPoint for each (starts[i], ends[i]), chunks of rays are spread over the pool's threads
+	void castRays(const sf::Vector2f* starts, const sf::Vector2f* ends, uint64_t count, RayHits& hits, ThreadPool* thread_pool = nullptr) const
+	{
+		hits.resize(count);
+		const uint64_t chunk_size = 256;
+		const uint32_t chunks_count = Tools::as<uint32_t>((count + chunk_size - 1) / chunk_size);
+		auto cast_chunk = [&](uint32_t chunk) {
+			const uint64_t begin = chunk * chunk_size;
+			castRaysRange(starts, ends, begin, std::min(count, begin + chunk_size), hits);
+		};
+		if (thread_pool) {
+			thread_pool->parallelFor(chunks_count, cast_chunk);
+		}
+		else {
+			for (uint32_t chunk(0); chunk < chunks_count; ++chunk) {
+				cast_chunk(chunk);
+			}
+		}
 	}
 
 	void setCellAtWorld(const sf::Vector2f& world_position, uint8_t value)
@@ -90,18 +206,36 @@ public:
 
 	void setCellAt(int32_t x, int32_t y, uint8_t value)
 	{
-		if (checkCoords(x, y)) {
-			data[getIndexFromCoords(x, y)] = value;
+		if (!checkCoords(x, y)) {
+			return;
+		}
+		if (storage == Storage::Chunked) {
+			if (chunks.setSolid(x, y, value == 1)) {
+				addChange(y, getIndexFromCoords(x, y));
+			}
+		}
+		else {
+			const uint64_t index = getIndexFromCoords(x, y);
+			if (data[index] != value) {
+				const int32_t solid_delta = (value == 1) - (data[index] == 1);
+				if (solid_delta) {
+					occupancy.add(x, y, solid_delta);
+				}
+				data[index] = value;
+				addChange(y, index);
+			}
 		}
 	}
 
 	uint8_t getCellContentAt(int32_t x, int32_t y) const
 	{
-		if (checkCoords(x, y)) {
-			return data[getIndexFromCoords(x, y)];
+		if (!checkCoords(x, y)) {
+			return 0u;
 		}
-
-		return 0u;
+		if (storage == Storage::Chunked) {
+			return chunks.isSolid(x, y) ? 1u : 0u;
+		}
+		return data[getIndexFromCoords(x, y)];
 	}
 
 	GridInfo getInfo() const
@@ -109,13 +243,150 @@ public:
 		return GridInfo(cell_size, width, height);
 	}
 
+	Storage getStorage() const
+	{
+		return storage;
+	}
+
+	// Bytes used by the cells and the structures derived from them
+	uint64_t getMemoryUsage() const
+	{
+		return data.capacity() + occupancy.getMemoryUsage() + chunks.getMemoryUsage();
+	}
+
+	// Incremented each time a cell changes, structures computed from the cells compare it to know if they are outdated
+	uint64_t getVersion() const
+	{
+		return version;
+	}
+
+	// The last changed cells are kept for any number of readers, each one remembers the version it last read.
+	// Returns false if too many cells changed since that version, getRowVersion then tells which rows changed
+	bool hasChangedCellsSince(uint64_t since_version) const
+	{
+		return version - since_version <= max_changed_cells;
+	}
+
+	// Calls callback(cell_index) for each change made after since_version, oldest first
+	template<typename TCallback>
+	void forEachChangedCell(uint64_t since_version, TCallback&& callback) const
+	{
+		for (uint64_t v(since_version); v < version; ++v) {
+			callback(changed_cells[v % max_changed_cells]);
+		}
+	}
+
+	// Version of the last change in the row, 0 if it never changed
+	uint64_t getRowVersion(int32_t y) const
+	{
+		return rows_versions[y];
+	}
+
 private:
 	int32_t cell_size;
 	int32_t width;
 	int32_t height;
+	Storage storage;
 	mutable std::vector<uint8_t> data;
+	GridChunks chunks;
+
+	static constexpr uint64_t max_changed_cells = 1024;
+	// Ring of the last changes, the one that made version v is at (v - 1) % max_changed_cells
+	std::vector<uint64_t> changed_cells;
+	std::vector<uint64_t> rows_versions;
+	uint64_t version;
+	GridOccupancy occupancy;
 
 private:
+	GridRay initRay(const sf::Vector2f& start, const sf::Vector2f& direction) const
+	{
+		GridRay ray;
+		toGridCoords(start, ray.cell);
+		ray.step[0] = Tools::as<int32_t>(Tools::sign(direction.x));
+		ray.step[1] = Tools::as<int32_t>(Tools::sign(direction.y));
+		const float cell_size_f = Tools::as<float>(cell_size);
+		const float inv_direction[]{ 1.0f / direction.x, 1.0f / direction.y };
+		ray.t_d[0] = GridRay::clampDelta(std::abs(cell_size_f * inv_direction[0]));
+		ray.t_d[1] = GridRay::clampDelta(std::abs(cell_size_f * inv_direction[1]));
+		ray.t_start[0] = ((ray.cell[0] + (ray.step[0] > 0)) * cell_size_f - start.x) * inv_direction[0];
+		ray.t_start[1] = ((ray.cell[1] + (ray.step[1] > 0)) * cell_size_f - start.y) * inv_direction[1];
+		ray.steps[0] = 0.0f;
+		ray.steps[1] = 0.0f;
+		return ray;
+	}
+
+	// Same walk as castRay, chunks replace the occupancy levels: uniform chunks are crossed or hit at once,
+	// in other chunks empty 8x8 blocks are crossed and the empty cells of the row ahead of the ray are found from the row's word
+	HitPoint castRayChunked(GridRay& ray, float max_dist) const
+	{
+		float distance = 0.0f;
+		while (true) {
+			const uint32_t axis = ray.getNextAxis();
+			const float t_next = ray.getNextTime(axis);
+			if (!(t_next < max_dist)) {
+				break;
+			}
+
+			const int32_t x = ray.cell[0];
+			const int32_t y = ray.cell[1];
+			if (checkCoords(x, y)) {
+				const uint32_t chunk = chunks.getChunk(x, y);
+				if (chunk == GridChunks::full_chunk) {
+					return HitPoint(true, distance, x, y);
+				}
+				if (chunk == GridChunks::empty_chunk) {
+					if (!ray.crossBlock(GridChunks::chunk_size, max_dist, distance)) {
+						break;
+					}
+					continue;
+				}
+
+				if (!((chunks.getBlocksMask(chunk) >> GridChunks::getBlockBit(x, y)) & 1)) {
+					if (!ray.crossBlock(GridChunks::block_size, max_dist, distance)) {
+						break;
+					}
+					continue;
+				}
+				const uint64_t row = chunks.getRow(chunk, y);
+				const int32_t bit = x & GridChunks::chunk_mask;
+				if ((row >> bit) & 1) {
+					return HitPoint(true, distance, x, y);
+				}
+				int32_t box_min[2]{ x, y };
+				int32_t box_max[2]{ x, y };
+				if (ray.step[0] > 0) {
+					const uint64_t ahead = row >> bit;
+					box_max[0] += (ahead ? GridChunks::countTrailingZeros(ahead) : GridChunks::chunk_size - bit) - 1;
+				}
+				else {
+					const uint64_t behind = row << (GridChunks::chunk_mask - bit);
+					box_min[0] -= (behind ? GridChunks::countLeadingZeros(behind) : bit + 1) - 1;
+				}
+				if (!ray.crossBox(box_min, box_max, max_dist, distance)) {
+					break;
+				}
+				continue;
+			}
+
+			distance = t_next;
+			ray.advance(axis, 1);
+		}
+
+		return HitPoint(false, max_dist, -1, -1);
+	}
+
+	void castRaysRange(const sf::Vector2f* starts, const sf::Vector2f* ends, uint64_t begin, uint64_t end, RayHits& hits) const
+	{
+		for (uint64_t i(begin); i < end; ++i) {
+			const HitPoint hit_point = castRayToPoint(starts[i], ends[i]);
+			hits.hit[i] = hit_point.hit;
+			hits.distance[i] = hit_point.distance;
+			hits.cell_x[i] = hit_point.cell_x;
+			hits.cell_y[i] = hit_point.cell_y;
+		}
+	}
+
+
 	sf::Vector2i toGridCoords(const sf::Vector2f& v) const
 	{
 		return sf::Vector2i(Tools::as<int32_t>(v.x / cell_size), Tools::as<int32_t>(v.y / cell_size));
@@ -129,13 +400,28 @@ private:
 
 	void clearDebug()
 	{
-		for (uint8_t& c : data) {
-			if (c == 2) {
-				c = 0;
+		for (int32_t y(0); y < height; ++y) {
+			for (int32_t x(0); x < width; ++x) {
+				if (getCellContentAt(x, y) == 2) {
+					setCellAt(x, y, 0);
+				}
 			}
 		}
 	}
 
+	void addChange(int32_t y, uint64_t index)
+	{
+		const uint64_t slot = version % max_changed_cells;
+		if (slot < changed_cells.size()) {
+			changed_cells[slot] = index;
+		}
+		else {
+			changed_cells.push_back(index);
+		}
+		++version;
+		rows_versions[y] = version;
+	}
+
 	uint64_t getIndexFromCoords(int32_t x, int32_t y) const
 	{
 		return Tools::as<uint64_t>(x) + Tools::as<uint64_t>(y) * Tools::as<uint64_t>(width);
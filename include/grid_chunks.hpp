@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+
+// Solid or empty state of the cells packed in bits, by chunks of 64x64 cells with one 64 bits word per row.
+// Chunks that are fully empty or fully solid have no words, only their state in the chunks table
+struct GridChunks
+{
+	static constexpr int32_t chunk_shift = 6;
+	static constexpr int32_t chunk_size = 1 << chunk_shift;
+	static constexpr int32_t chunk_mask = chunk_size - 1;
+	static constexpr uint32_t empty_chunk = 0xFFFFFFFFu;
+	static constexpr uint32_t full_chunk = 0xFFFFFFFEu;
+	// Chunks with words also have one bit per block of 8x8 cells set if the block has solid cells
+	static constexpr int32_t block_shift = 3;
+	static constexpr int32_t block_size = 1 << block_shift;
+
+	GridChunks()
+		: chunks_width(0)
+		, chunks_height(0)
+	{}
+
+	void resize(int32_t grid_width, int32_t grid_height)
+	{
+		chunks_width = (grid_width + chunk_mask) >> chunk_shift;
+		chunks_height = (grid_height + chunk_mask) >> chunk_shift;
+		chunks.assign(static_cast<uint64_t>(chunks_width) * static_cast<uint64_t>(chunks_height), empty_chunk);
+		words.clear();
+		blocks_masks.clear();
+		solid_counts.clear();
+		free_chunks.clear();
+	}
+
+	// Either empty_chunk, full_chunk or the index of the chunk's words, the cell must be in the grid
+	uint32_t getChunk(int32_t x, int32_t y) const
+	{
+		return chunks[getChunkIndex(x, y)];
+	}
+
+	// Row of the chunk containing the cell, bit i is the cell at the chunk's x + i
+	uint64_t getRow(uint32_t chunk, int32_t y) const
+	{
+		return words[(static_cast<uint64_t>(chunk) << chunk_shift) + (y & chunk_mask)];
+	}
+
+	// Bit of the cell's block in getBlocksMask
+	static int32_t getBlockBit(int32_t x, int32_t y)
+	{
+		return (((y & chunk_mask) >> block_shift) << (chunk_shift - block_shift)) + ((x & chunk_mask) >> block_shift);
+	}
+
+	uint64_t getBlocksMask(uint32_t chunk) const
+	{
+		return blocks_masks[chunk];
+	}
+
+	bool isSolid(int32_t x, int32_t y) const
+	{
+		const uint32_t chunk = getChunk(x, y);
+		if (chunk == empty_chunk || chunk == full_chunk) {
+			return chunk == full_chunk;
+		}
+		return (getRow(chunk, y) >> (x & chunk_mask)) & 1;
+	}
+
+	// Returns true if the cell's state changed
+	bool setSolid(int32_t x, int32_t y, bool solid)
+	{
+		uint32_t& chunk = chunks[getChunkIndex(x, y)];
+		if (chunk == (solid ? full_chunk : empty_chunk)) {
+			return false;
+		}
+		if (chunk == empty_chunk || chunk == full_chunk) {
+			chunk = createChunk(chunk == full_chunk);
+		}
+
+		uint64_t& row = words[(static_cast<uint64_t>(chunk) << chunk_shift) + (y & chunk_mask)];
+		const uint64_t bit = uint64_t(1) << (x & chunk_mask);
+		if (((row & bit) != 0) == solid) {
+			return false;
+		}
+		row ^= bit;
+		updateBlocksMask(chunk, x, y);
+		uint32_t& solid_count = solid_counts[chunk];
+		solid_count = solid ? solid_count + 1 : solid_count - 1;
+		// Back to an implicit chunk as soon as it is uniform again
+		if (!solid_count || solid_count == chunk_size * chunk_size) {
+			free_chunks.push_back(chunk);
+			chunk = solid_count ? full_chunk : empty_chunk;
+		}
+		return true;
+	}
+
+	// Index of the lowest set bit, value must not be 0
+	static int32_t countTrailingZeros(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<int32_t>(index);
+#else
+		return __builtin_ctzll(value);
+#endif
+	}
+
+	// Number of zeros above the highest set bit, value must not be 0
+	static int32_t countLeadingZeros(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return 63 - static_cast<int32_t>(index);
+#else
+		return __builtin_clzll(value);
+#endif
+	}
+
+	// Bytes used by the cells' states
+	uint64_t getMemoryUsage() const
+	{
+		return chunks.capacity() * sizeof(uint32_t) + words.capacity() * sizeof(uint64_t) +
+			   blocks_masks.capacity() * sizeof(uint64_t) + solid_counts.capacity() * sizeof(uint32_t) +
+			   free_chunks.capacity() * sizeof(uint32_t);
+	}
+
+private:
+	int32_t chunks_width;
+	int32_t chunks_height;
+	std::vector<uint32_t> chunks;
+	// chunk_size words per chunk with words
+	std::vector<uint64_t> words;
+	std::vector<uint64_t> blocks_masks;
+	std::vector<uint32_t> solid_counts;
+	// Chunks with words that became uniform, their words are reused first
+	std::vector<uint32_t> free_chunks;
+
+	uint64_t getChunkIndex(int32_t x, int32_t y) const
+	{
+		return static_cast<uint64_t>(x >> chunk_shift) + static_cast<uint64_t>(y >> chunk_shift) * static_cast<uint64_t>(chunks_width);
+	}
+
+	uint32_t createChunk(bool solid)
+	{
+		uint32_t chunk;
+		if (free_chunks.empty()) {
+			chunk = static_cast<uint32_t>(solid_counts.size());
+			solid_counts.push_back(0);
+			blocks_masks.push_back(0);
+			words.resize(words.size() + chunk_size);
+		}
+		else {
+			chunk = free_chunks.back();
+			free_chunks.pop_back();
+		}
+		const uint64_t first_word = static_cast<uint64_t>(chunk) << chunk_shift;
+		for (int32_t i(0); i < chunk_size; ++i) {
+			words[first_word + i] = solid ? ~uint64_t(0) : 0;
+		}
+		solid_counts[chunk] = solid ? chunk_size * chunk_size : 0;
+		blocks_masks[chunk] = solid ? ~uint64_t(0) : 0;
+		return chunk;
+	}
+
+	void updateBlocksMask(uint32_t chunk, int32_t x, int32_t y)
+	{
+		const uint64_t first_row = (static_cast<uint64_t>(chunk) << chunk_shift) + ((y & chunk_mask) & ~(block_size - 1));
+		const int32_t shift = (x & chunk_mask) & ~(block_size - 1);
+		uint64_t block_rows = 0;
+		for (int32_t i(0); i < block_size; ++i) {
+			block_rows |= words[first_row + i];
+		}
+		const uint64_t bit = uint64_t(1) << getBlockBit(x, y);
+		if ((block_rows >> shift) & ((uint64_t(1) << block_size) - 1)) {
+			blocks_masks[chunk] |= bit;
+		}
+		else {
+			blocks_masks[chunk] &= ~bit;
+		}
+	}
+};
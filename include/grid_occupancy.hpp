@@ -0,0 +1,160 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+
+// State of a ray walking through the grid's cells. Crossing times are computed from the number of
+// crossings instead of being accumulated so jumping over several cells gives the same values as stepping
+struct GridRay
+{
+	int32_t cell[2];
+	int32_t step[2];
+	// Time of the first crossing and between two crossings on each axis
+	float t_start[2];
+	float t_d[2];
+	// Crossings done on each axis
+	float steps[2];
+
+	float getTime(uint32_t axis, float steps_count) const
+	{
+		return t_start[axis] + steps_count * t_d[axis];
+	}
+
+	float getNextTime(uint32_t axis) const
+	{
+		return getTime(axis, steps[axis]);
+	}
+
+	// Ties go to the y axis
+	uint32_t getNextAxis() const
+	{
+		return getNextTime(0) >= getNextTime(1);
+	}
+
+	void advance(uint32_t axis, int32_t count)
+	{
+		steps[axis] += static_cast<float>(count);
+		cell[axis] += count * step[axis];
+	}
+
+	// Moves the ray to the first cell out of the box of cells [box_min, box_max] containing its cell, as the
+	// cell by cell walk would. Returns false if the ray ends before leaving the box
+	bool crossBox(const int32_t* box_min, const int32_t* box_max, float max_dist, float& distance)
+	{
+		int32_t to_exit[2];
+		float exit_time[2];
+		for (uint32_t axis(0); axis < 2; ++axis) {
+			to_exit[axis] = (step[axis] > 0) ? box_max[axis] - cell[axis] + 1 : cell[axis] - box_min[axis] + 1;
+			exit_time[axis] = getTime(axis, steps[axis] + static_cast<float>(to_exit[axis] - 1));
+		}
+
+		const uint32_t axis = exit_time[0] >= exit_time[1];
+		const uint32_t other = 1 - axis;
+		const float exit = exit_time[axis];
+		if (!(exit < max_dist)) {
+			return false;
+		}
+		// Crossings on the other axis done before leaving, with the same tie rule as getNextAxis.
+		// Estimated with a division then fixed with the exact comparisons the cell by cell walk does
+		const auto before_exit = [&](int32_t other_steps) {
+			const float t = getTime(other, steps[other] + static_cast<float>(other_steps));
+			return axis ? (t < exit) : (t <= exit);
+		};
+		const int32_t max_other_steps = to_exit[other] - 1;
+		const float estimate = (exit - t_start[other]) / t_d[other] - steps[other] + 1.0f;
+		int32_t other_steps = (estimate > 0.0f) ? static_cast<int32_t>(std::min(estimate, static_cast<float>(max_other_steps))) : 0;
+		while (other_steps > 0 && !before_exit(other_steps - 1)) {
+			--other_steps;
+		}
+		while (other_steps < max_other_steps && before_exit(other_steps)) {
+			++other_steps;
+		}
+
+		advance(axis, to_exit[axis]);
+		advance(other, other_steps);
+		distance = exit;
+		return true;
+	}
+
+	// Same as crossBox for the aligned square block of block_size cells, a power of two
+	bool crossBlock(int32_t block_size, float max_dist, float& distance)
+	{
+		const int32_t box_min[2]{ cell[0] & ~(block_size - 1), cell[1] & ~(block_size - 1) };
+		const int32_t box_max[2]{ box_min[0] + block_size - 1, box_min[1] + block_size - 1 };
+		return crossBox(box_min, box_max, max_dist, distance);
+	}
+
+	// Largest finite value instead of infinity so 0 crossings on an axis parallel to the ray don't give NaN
+	static float clampDelta(float t_d)
+	{
+		return std::min(t_d, std::numeric_limits<float>::max());
+	}
+};
+
+
+// Count of solid cells per square block of 4x4, 16x16 and 64x64 cells, kept up to date by Grid::setCellAt.
+// Rays cross empty blocks in one jump and only read cells in blocks that contain solid ones
+struct GridOccupancy
+{
+	static constexpr uint32_t levels_count = 3;
+
+	void resize(int32_t grid_width, int32_t grid_height)
+	{
+		for (uint32_t i(0); i < levels_count; ++i) {
+			Level& level = levels[i];
+			const int32_t block_size = 1 << level.shift;
+			level.width = (grid_width + block_size - 1) / block_size;
+			level.height = (grid_height + block_size - 1) / block_size;
+			level.solid_count.assign(static_cast<uint64_t>(level.width) * static_cast<uint64_t>(level.height), 0);
+		}
+	}
+
+	// The cell must be in the grid
+	void add(int32_t x, int32_t y, int32_t delta)
+	{
+		for (Level& level : levels) {
+			level.solid_count[level.getIndex(x, y)] += static_cast<uint16_t>(delta);
+		}
+	}
+
+	// Size of the largest empty block containing the cell, 0 if the cell's smallest block is not empty.
+	// Blocks contain the smaller ones so the finest level is read first, dense areas only pay one read
+	int32_t getEmptyBlockSize(int32_t x, int32_t y) const
+	{
+		int32_t block_size = 0;
+		for (const Level& level : levels) {
+			if (level.solid_count[level.getIndex(x, y)]) {
+				break;
+			}
+			block_size = 1 << level.shift;
+		}
+		return block_size;
+	}
+
+	uint64_t getMemoryUsage() const
+	{
+		uint64_t bytes = 0;
+		for (const Level& level : levels) {
+			bytes += level.solid_count.capacity() * sizeof(uint16_t);
+		}
+		return bytes;
+	}
+
+private:
+	struct Level
+	{
+		int32_t shift;
+		int32_t width, height;
+		std::vector<uint16_t> solid_count;
+
+		uint64_t getIndex(int32_t x, int32_t y) const
+		{
+			return static_cast<uint64_t>(x >> shift) + static_cast<uint64_t>(y >> shift) * static_cast<uint64_t>(width);
+		}
+	};
+
+	// Finest first
+	Level levels[levels_count]{ { 2, 0, 0, {} }, { 4, 0, 0, {} }, { 6, 0, 0, {} } };
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+
+// Groups objects linked by contacts into connected components using union find
+struct Islands
+{
+	Islands()
+		: islands_count(0)
+	{}
+
+	void reset(uint64_t objects_count)
+	{
+		roots.resize(objects_count);
+		for (uint32_t i(0); i < objects_count; ++i) {
+			roots[i] = i;
+		}
+		islands_count = 0;
+	}
+
+	void link(uint32_t a, uint32_t b)
+	{
+		const uint32_t root_a = find(a);
+		const uint32_t root_b = find(b);
+		if (root_a != root_b) {
+			roots[root_a] = root_b;
+		}
+	}
+
+	// Assigns an island id to each object and lists objects per island
+	void build()
+	{
+		const uint64_t objects_count = roots.size();
+		objects_island.assign(objects_count, 0);
+		root_island.assign(objects_count, invalid_island);
+		islands_count = 0;
+		for (uint32_t i(0); i < objects_count; ++i) {
+			const uint32_t root = find(i);
+			if (root_island[root] == invalid_island) {
+				root_island[root] = islands_count++;
+			}
+			objects_island[i] = root_island[root];
+		}
+
+		offsets.assign(islands_count + 1, 0);
+		for (uint32_t island : objects_island) {
+			++offsets[island + 1];
+		}
+		for (uint32_t i(0); i < islands_count; ++i) {
+			offsets[i + 1] += offsets[i];
+		}
+		objects.resize(objects_count);
+		cursors.assign(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i(0); i < objects_count; ++i) {
+			objects[cursors[objects_island[i]]++] = i;
+		}
+	}
+
+	template<typename TCallback>
+	void forEachObject(uint32_t island, TCallback&& callback) const
+	{
+		for (uint32_t i(offsets[island]); i < offsets[island + 1]; ++i) {
+			callback(objects[i]);
+		}
+	}
+
+	uint32_t getIslandSize(uint32_t island) const
+	{
+		return offsets[island + 1] - offsets[island];
+	}
+
+	uint32_t islands_count;
+	std::vector<uint32_t> objects_island;
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> objects;
+
+private:
+	static constexpr uint32_t invalid_island = 0xFFFFFFFF;
+
+	std::vector<uint32_t> roots;
+	std::vector<uint32_t> root_island;
+	std::vector<uint32_t> cursors;
+
+	uint32_t find(uint32_t i)
+	{
+		while (roots[i] != i) {
+			roots[i] = roots[roots[i]];
+			i = roots[i];
+		}
+		return i;
+	}
+};
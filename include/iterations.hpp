@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+
+// Number of solver iterations, either fixed or until impulses stop changing
+struct IterationsSettings
+{
+	bool adaptive = false;
+	// Used when not adaptive
+	uint32_t iterations_count = 8;
+	uint32_t min_iterations_count = 2;
+	uint32_t max_iterations_count = 16;
+	// Biggest impulse change allowed in the last iteration
+	float tolerance = 0.5f;
+
+	uint32_t getMaxIterationsCount() const
+	{
+		return adaptive ? max_iterations_count : iterations_count;
+	}
+
+	bool isConverged(uint32_t done_iterations_count, float residual) const
+	{
+		return adaptive && done_iterations_count >= min_iterations_count && residual < tolerance;
+	}
+};
+
+
+struct ConvergenceStats
+{
+	uint32_t iterations_count = 0;
+	// Biggest impulse change in the last iteration
+	float residual = 0.0f;
+};
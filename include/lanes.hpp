@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+	#define HORD_LANES_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define HORD_TARGET_AVX __attribute__((target("avx")))
+#else
+	#define HORD_TARGET_AVX
+#endif
+
+
+// Float vector operations for the SIMD kernels, masks are vectors with all bits set in true lanes
+#ifdef HORD_LANES_X86
+struct LanesSSE
+{
+	typedef __m128 Type;
+	static constexpr uint32_t width = 4;
+
+	static Type zero() { return _mm_setzero_ps(); }
+	static Type load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, Type v) { _mm_storeu_ps(p, v); }
+	static Type add(Type a, Type b) { return _mm_add_ps(a, b); }
+	static Type sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+	static Type mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+	static Type div(Type a, Type b) { return _mm_div_ps(a, b); }
+	static Type sqrt(Type a) { return _mm_sqrt_ps(a); }
+	// Rounds toward zero, values must fit in an int32
+	static Type truncate(Type a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+	static Type less(Type a, Type b) { return _mm_cmplt_ps(a, b); }
+	static Type max(Type a, Type b) { return _mm_max_ps(a, b); }
+	static Type min(Type a, Type b) { return _mm_min_ps(a, b); }
+	static Type abs(Type a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	// mask ? a : b
+	static Type select(Type mask, Type a, Type b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static Type set(float f) { return _mm_set1_ps(f); }
+	static Type greaterEqual(Type a, Type b) { return _mm_cmpge_ps(a, b); }
+	static Type bitAnd(Type a, Type b) { return _mm_and_ps(a, b); }
+	// ~a & b
+	static Type bitAndNot(Type a, Type b) { return _mm_andnot_ps(a, b); }
+	// One bit per lane
+	static int getMask(Type mask) { return _mm_movemask_ps(mask); }
+};
+
+
+struct LanesAVX
+{
+	typedef __m256 Type;
+	static constexpr uint32_t width = 8;
+
+	HORD_TARGET_AVX static Type zero() { return _mm256_setzero_ps(); }
+	HORD_TARGET_AVX static Type load(const float* p) { return _mm256_loadu_ps(p); }
+	HORD_TARGET_AVX static void store(float* p, Type v) { _mm256_storeu_ps(p, v); }
+	HORD_TARGET_AVX static Type add(Type a, Type b) { return _mm256_add_ps(a, b); }
+	HORD_TARGET_AVX static Type sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+	HORD_TARGET_AVX static Type mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+	HORD_TARGET_AVX static Type div(Type a, Type b) { return _mm256_div_ps(a, b); }
+	HORD_TARGET_AVX static Type sqrt(Type a) { return _mm256_sqrt_ps(a); }
+	HORD_TARGET_AVX static Type truncate(Type a) { return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(a)); }
+	HORD_TARGET_AVX static Type less(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	HORD_TARGET_AVX static Type max(Type a, Type b) { return _mm256_max_ps(a, b); }
+	HORD_TARGET_AVX static Type min(Type a, Type b) { return _mm256_min_ps(a, b); }
+	HORD_TARGET_AVX static Type abs(Type a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	HORD_TARGET_AVX static Type select(Type mask, Type a, Type b) { return _mm256_blendv_ps(b, a, mask); }
+	HORD_TARGET_AVX static Type set(float f) { return _mm256_set1_ps(f); }
+	HORD_TARGET_AVX static Type greaterEqual(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	HORD_TARGET_AVX static Type bitAnd(Type a, Type b) { return _mm256_and_ps(a, b); }
+	HORD_TARGET_AVX static Type bitAndNot(Type a, Type b) { return _mm256_andnot_ps(a, b); }
+	HORD_TARGET_AVX static int getMask(Type mask) { return _mm256_movemask_ps(mask); }
+};
+
+
+inline bool hasAVXSupport()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const bool os_saves_ymm = (info[2] & (1 << 27)) && ((_xgetbv(0) & 6) == 6);
+	return os_saves_ymm && (info[2] & (1 << 28));
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "physic_objects.hpp"
+#include "spatial_hash.hpp"
+
+
+// Verlet lists, each atom keeps the atoms closer than the sum of the radii plus a skin.
+// Lists stay valid until an atom has moved more than half the skin since the last rebuild
+struct NeighbourList
+{
+	NeighbourList(float skin_ = 4.0f)
+		: skin(skin_)
+		, rebuilds_count(0)
+		, steps_count(0)
+	{}
+
+	// Returns true if the lists had to be rebuilt
+	bool update(const AtomStorage& atoms)
+	{
+		++steps_count;
+		if (!needsRebuild(atoms)) {
+			return false;
+		}
+		rebuild(atoms);
+		++rebuilds_count;
+		return true;
+	}
+
+	// Calls callback(i, k) for each neighbour pair, with i < k
+	template<typename TCallback>
+	void forEachPair(TCallback&& callback) const
+	{
+		const uint64_t atoms_count = reference_positions.size();
+		for (uint64_t i(0); i < atoms_count; ++i) {
+			for (uint64_t n(offsets[i]); n < offsets[i + 1]; ++n) {
+				callback(i, neighbours[n]);
+			}
+		}
+	}
+
+	float getRebuildRate() const
+	{
+		return steps_count ? static_cast<float>(rebuilds_count) / static_cast<float>(steps_count) : 0.0f;
+	}
+
+	void resetStats()
+	{
+		rebuilds_count = 0;
+		steps_count = 0;
+	}
+
+	float skin;
+	uint64_t rebuilds_count;
+	uint64_t steps_count;
+
+	std::vector<uint64_t> offsets;
+	std::vector<uint64_t> neighbours;
+	std::vector<Vec2> reference_positions;
+
+private:
+	SpatialHash spatial_hash;
+
+	bool needsRebuild(const AtomStorage& atoms) const
+	{
+		const uint64_t atoms_count = atoms.size();
+		if (atoms_count != reference_positions.size()) {
+			return true;
+		}
+		const float max_displacement = 0.5f * skin;
+		const float max_displacement2 = max_displacement * max_displacement;
+		for (uint64_t i(0); i < atoms_count; ++i) {
+			if ((atoms.getPosition(i) - reference_positions[i]).getLength2() > max_displacement2) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void rebuild(const AtomStorage& atoms)
+	{
+		float max_radius = 0.0f;
+		for (float radius : atoms.radius) {
+			max_radius = std::max(max_radius, radius);
+		}
+		spatial_hash.build(atoms, 2.0f * max_radius + skin);
+
+		const uint64_t atoms_count = atoms.size();
+		offsets.resize(atoms_count + 1);
+		neighbours.clear();
+		reference_positions.resize(atoms_count);
+		for (uint64_t i(0); i < atoms_count; ++i) {
+			const Vec2 position = atoms.getPosition(i);
+			reference_positions[i] = position;
+			offsets[i] = neighbours.size();
+			spatial_hash.forEachNeighbour(position, [&](uint64_t k) {
+				if (k <= i || atoms.parent[i] == atoms.parent[k]) {
+					return;
+				}
+				const float range = atoms.radius[i] + atoms.radius[k] + skin;
+				if ((position - atoms.getPosition(k)).getLength2() < range * range) {
+					neighbours.push_back(k);
+				}
+			});
+		}
+		offsets[atoms_count] = neighbours.size();
+	}
+};
@@ -0,0 +1,234 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+
+// Unordered (id_a, id_b) pairs of 32 bits ids packed in a single 64 bits key
+struct UnorderedPairKey
+{
+	using Type = uint64_t;
+
+	static Type make(uint64_t a, uint64_t b)
+	{
+		return (a < b) ? ((a << 32) | b) : ((b << 32) | a);
+	}
+
+	static Type empty()
+	{
+		return ~0ull;
+	}
+
+	static bool isEmpty(Type key)
+	{
+		return key == empty();
+	}
+
+	static uint64_t hash(Type key)
+	{
+		return key * 0x9E3779B97F4A7C15ull;
+	}
+
+	static uint64_t first(Type key)
+	{
+		return key >> 32;
+	}
+
+	static uint64_t second(Type key)
+	{
+		return key & 0xFFFFFFFFull;
+	}
+};
+
+
+// Ordered (atom, cell) pairs with 64 bits cell indices, so grids of more than 2^32 cells are supported
+struct AtomCellKey
+{
+	struct Type
+	{
+		uint64_t atom;
+		uint64_t cell;
+
+		bool operator==(const Type& other) const
+		{
+			return atom == other.atom && cell == other.cell;
+		}
+	};
+
+	static Type make(uint64_t atom, uint64_t cell)
+	{
+		return Type{ atom, cell };
+	}
+
+	static Type empty()
+	{
+		return Type{ ~0ull, 0 };
+	}
+
+	static bool isEmpty(const Type& key)
+	{
+		return key.atom == ~0ull;
+	}
+
+	static uint64_t hash(const Type& key)
+	{
+		return ((key.atom * 0x9E3779B97F4A7C15ull) ^ (key.cell * 0xC2B2AE3D27D4EB4Full)) * 0x9E3779B97F4A7C15ull;
+	}
+
+	static uint64_t first(const Type& key)
+	{
+		return key.atom;
+	}
+
+	static uint64_t second(const Type& key)
+	{
+		return key.cell;
+	}
+};
+
+
+// Open addressing set of pairs, its size follows the number of stored pairs.
+// TKey gives the key type, how pairs are packed into it and its hash
+template<typename TKey>
+struct BasicPairCache
+{
+	using Key = typename TKey::Type;
+
+	BasicPairCache()
+		: count(0)
+		, shift(64 - min_capacity_bits)
+		, keys(1ull << min_capacity_bits, TKey::empty())
+	{}
+
+	bool contains(uint64_t a, uint64_t b) const
+	{
+		const Key key = TKey::make(a, b);
+		for (uint64_t i(getSlot(key)); !TKey::isEmpty(keys[i]); i = next(i)) {
+			if (keys[i] == key) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Returns false if the pair was already there
+	bool insert(uint64_t a, uint64_t b)
+	{
+		if (2 * (count + 1) > keys.size()) {
+			rehash(keys.size() << 1);
+		}
+		return insertKey(TKey::make(a, b));
+	}
+
+	// Returns false if the pair wasn't there
+	bool remove(uint64_t a, uint64_t b)
+	{
+		const Key key = TKey::make(a, b);
+		uint64_t i = getSlot(key);
+		while (!(keys[i] == key)) {
+			if (TKey::isEmpty(keys[i])) {
+				return false;
+			}
+			i = next(i);
+		}
+		// Backward shift deletion, no tombstones are needed
+		uint64_t hole = i;
+		for (uint64_t k(next(i)); !TKey::isEmpty(keys[k]); k = next(k)) {
+			const uint64_t home = getSlot(keys[k]);
+			if (((k - home) & getMask()) >= ((k - hole) & getMask())) {
+				keys[hole] = keys[k];
+				hole = k;
+			}
+		}
+		keys[hole] = TKey::empty();
+		--count;
+
+		if (8 * count < keys.size() && keys.size() > (1ull << min_capacity_bits)) {
+			rehash(keys.size() >> 1);
+		}
+		return true;
+	}
+
+	// Calls callback(a, b) for each stored pair, unordered pairs are given with a < b
+	template<typename TCallback>
+	void forEach(TCallback&& callback) const
+	{
+		for (const Key& key : keys) {
+			if (!TKey::isEmpty(key)) {
+				callback(TKey::first(key), TKey::second(key));
+			}
+		}
+	}
+
+	void clear()
+	{
+		keys.assign(1ull << min_capacity_bits, TKey::empty());
+		shift = 64 - min_capacity_bits;
+		count = 0;
+	}
+
+	uint64_t size() const
+	{
+		return count;
+	}
+
+	uint64_t getCapacity() const
+	{
+		return keys.size();
+	}
+
+private:
+	static constexpr uint32_t min_capacity_bits = 6;
+
+	uint64_t count;
+	uint32_t shift;
+	std::vector<Key> keys;
+
+	uint64_t getSlot(const Key& key) const
+	{
+		return TKey::hash(key) >> shift;
+	}
+
+	uint64_t getMask() const
+	{
+		return keys.size() - 1;
+	}
+
+	uint64_t next(uint64_t i) const
+	{
+		return (i + 1) & getMask();
+	}
+
+	bool insertKey(const Key& key)
+	{
+		uint64_t i = getSlot(key);
+		while (!TKey::isEmpty(keys[i])) {
+			if (keys[i] == key) {
+				return false;
+			}
+			i = next(i);
+		}
+		keys[i] = key;
+		++count;
+		return true;
+	}
+
+	void rehash(uint64_t new_capacity)
+	{
+		std::vector<Key> old_keys(new_capacity, TKey::empty());
+		old_keys.swap(keys);
+		shift = 64;
+		for (uint64_t c(new_capacity); c > 1; c >>= 1) {
+			--shift;
+		}
+		count = 0;
+		for (const Key& key : old_keys) {
+			if (!TKey::isEmpty(key)) {
+				insertKey(key);
+			}
+		}
+	}
+};
+
+
+using PairCache = BasicPairCache<UnorderedPairKey>;
+using AtomCellCache = BasicPairCache<AtomCellKey>;
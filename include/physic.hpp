@@ -1,120 +1,859 @@
 #pragma once
 #include <vector>
-#include <list>
+#include <algorithm>
 #include "physic_objects.hpp"
 #include "contact.hpp"
+#include "spatial_hash.hpp"
+#include "pair_cache.hpp"
+#include "sweep_and_prune.hpp"
+#include "aabb_tree.hpp"
+#include "neighbour_list.hpp"
+#include "islands.hpp"
+#include "thread_pool.hpp"
+#include "contact_lanes.hpp"
+#include "slot_map.hpp"
+#include "frame_arena.hpp"
+#include "iterations.hpp"
+#include "grid.hpp"
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <cassert>
 #include <set>
+#include <limits>
 
 
-struct Solver
+struct BroadPhaseStats
 {
-	Solver()
+	uint64_t objects_pairs_count = 0;
+	uint64_t candidates_count = 0;
+	uint64_t new_contacts_count = 0;
+};
+
+
+// Time spent in each phase of the last Solver::update
+struct StepTimings
+{
+	uint64_t integration_ns = 0;
+	uint64_t contacts_ns = 0;
+	uint64_t islands_ns = 0;
+	uint64_t solve_ns = 0;
+	uint64_t positions_ns = 0;
+	uint64_t sleeping_ns = 0;
+
+	uint64_t getTotal() const
 	{
-		contacts_states.resize(1000);
-		for (std::vector<uint64_t>& v : contacts_states) {
-			v.resize(1000);
-		}
+		return integration_ns + contacts_ns + islands_ns + solve_ns + positions_ns + sleeping_ns;
 	}
+};
+
+
+struct Solver
+{
+	enum class BroadPhase {
+		BruteForce = 0,
+		SpatialHash = 1,
+		SweepAndPrune = 2,
+		AABBTree = 3,
+		NeighbourList = 4
+	};
+
+	enum class SolveMode {
+		Sequential = 0,
+		IslandsParallel = 1,
+		GraphColoring = 2,
+		SIMDLanes = 3
+	};
+
+	Solver()
+		: grid(nullptr)
+		, grid_version(0)
+		, grid_body{ std::numeric_limits<uint32_t>::max(), 0 }
+		, broad_phase(BroadPhase::SpatialHash)
+		, solve_mode(SolveMode::Sequential)
+		, threads_count(0)
+		, colors_count(0)
+		, allow_sleeping(true)
+		, sleep_max_velocity(5.0f)
+		, sleep_max_angular_velocity(0.05f)
+		, sleep_frames_count(60)
+	{}
 
 	bool isNewContact(uint64_t i, uint64_t k) const
 	{
-		return !(contacts_states[i][k] + contacts_states[k][i]);
+		return !contacts_cache.contains(i, k);
 	}
 
 	void setContact(uint64_t i, uint64_t k)
 	{
-		contacts_states[i][k] = 1;
+		contacts_cache.insert(i, k);
 	}
 
 	void removeContact(uint64_t i, uint64_t k)
 	{
-		contacts_states[i][k] = 0;
-		contacts_states[k][i] = 0;
+		contacts_cache.remove(i, k);
+	}
+
+	// Contacts order doesn't matter, the last one takes the place of the removed one
+	void removeContactAt(uint64_t i)
+	{
+		if (atom_contacts[i].with_cell) {
+			cell_contacts_cache.remove(atom_contacts[i].id_a, atom_contacts[i].id_b);
+		}
+		else {
+			removeContact(atom_contacts[i].id_a, atom_contacts[i].id_b);
+		}
+		atom_contacts[i] = atom_contacts.back();
+		atom_contacts.pop_back();
 	}
 
 	void updateContacts()
 	{
-		for (auto it = atom_contacts.begin(); it != atom_contacts.end(); ++it) {
-			if (it->isValid(atoms)) {
-				it->initialize_jacobians(atoms);
+		for (uint64_t i(0); i < atom_contacts.size();) {
+			AtomContact& c = atom_contacts[i];
+			if (c.isValid(atoms)) {
+				c.initialize_jacobians(atoms, objects);
+				++i;
 			}
 			else {
-				removeContact(it->id_a, it->id_b);
-				it = atom_contacts.erase(it)--;
+				removeContactAt(i);
 			}
 		}
 	}
 
 	void findContacts()
 	{
+		// Cell contacts are checked again against the cells when the grid changed
+		const bool grid_changed = grid && grid->getVersion() != grid_version;
+		if (grid) {
+			grid_version = grid->getVersion();
+		}
 		// Check for persistence here
-		atom_contacts.remove_if([&](AtomContact& c) { 
-			if (c.isValid(atoms)) {
-				c.initialize_jacobians(atoms);
-				c.applyLastImpulse(atoms);
-				return false;
+		for (uint64_t i(0); i < atom_contacts.size();) {
+			AtomContact& c = atom_contacts[i];
+			if (c.with_cell && grid_changed && !updateCellContact(c)) {
+				// The body may have been resting on the cell
+				objects[c.body_a].wake();
+				removeContactAt(i);
+			}
+			// Sleeping atoms don't move, their contacts stay as they are
+			else if (!isContactAwake(c)) {
+				++i;
+			}
+			else if (c.isValid(atoms)) {
+				c.initialize_jacobians(atoms, objects);
+				c.warmStart(objects);
+				++i;
 			}
 			else {
-				removeContact(c.id_a, c.id_b);
-				return true;
+				removeContactAt(i);
 			}
-		});
+		}
 		
+		broad_phase_stats = BroadPhaseStats();
+		switch (broad_phase) {
+		case BroadPhase::BruteForce:
+			findContactsBruteForce();
+			break;
+		case BroadPhase::SpatialHash:
+			findContactsSpatialHash();
+			break;
+		case BroadPhase::SweepAndPrune:
+			findContactsSweepAndPrune();
+			break;
+		case BroadPhase::AABBTree:
+			findContactsAABBTree();
+			break;
+		case BroadPhase::NeighbourList:
+			findContactsNeighbourList();
+			break;
+		}
+
+		if (grid) {
+			findCellContacts();
+		}
+	}
+
+	// Static level collisions, cells stay out of the broad phase. Each awake atom is only tested against the solid
+	// cells its box overlaps so the size of the level doesn't matter, only what touches it.
+	// The grid must outlive the solver and not change during update
+	void setGrid(const Grid* grid_)
+	{
+		for (uint64_t i(0); i < atom_contacts.size();) {
+			if (atom_contacts[i].with_cell) {
+				removeContactAt(i);
+			}
+			else {
+				++i;
+			}
+		}
+		grid = grid_;
+		if (grid) {
+			grid_version = grid->getVersion();
+			if (!objects.isValid(grid_body)) {
+				grid_body = objects.add();
+				objects[grid_body.index].moving = false;
+			}
+		}
+	}
+
+	void findCellContacts()
+	{
+		const GridInfo info = grid->getInfo();
+		const float inv_cell_size = 1.0f / Tools::as<float>(info.cell_size);
+		// Atoms of sleeping and static objects are not even visited
+		for (const ComposedObject& o : objects) {
+			if (!o.isAwake()) {
+				continue;
+			}
+			for (const uint64_t i : o.atoms_ids) {
+				const float x = atoms.x[i];
+				const float y = atoms.y[i];
+				const float radius = atoms.radius[i];
+				const int32_t min_x = std::max(0, Tools::as<int32_t>(std::floor((x - radius) * inv_cell_size)));
+				const int32_t min_y = std::max(0, Tools::as<int32_t>(std::floor((y - radius) * inv_cell_size)));
+				const int32_t max_x = std::min(info.width - 1, Tools::as<int32_t>(std::floor((x + radius) * inv_cell_size)));
+				const int32_t max_y = std::min(info.height - 1, Tools::as<int32_t>(std::floor((y + radius) * inv_cell_size)));
+				for (int32_t cell_y(min_y); cell_y <= max_y; ++cell_y) {
+					for (int32_t cell_x(min_x); cell_x <= max_x; ++cell_x) {
+						if (isSolidCell(cell_x, cell_y)) {
+							checkCellContact(i, cell_x, cell_y);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void checkCellContact(uint64_t atom, int32_t cell_x, int32_t cell_y)
+	{
+		++broad_phase_stats.candidates_count;
+		const uint64_t cell = getCellIndex(cell_x, cell_y);
+		if (cell_contacts_cache.contains(atom, cell)) {
+			return;
+		}
+		const float cell_size = Tools::as<float>(grid->getInfo().cell_size);
+		const Vec2 cell_min(cell_x * cell_size, cell_y * cell_size);
+		AtomContact contact(atom, atoms.parent[atom], cell, grid_body.index, cell_min, cell_min.plus(Vec2(cell_size, cell_size)),
+			                getSolidNeighbours(cell_x, cell_y));
+		if (contact.isValid(atoms)) {
+			contact.initialize(atoms, objects);
+			atom_contacts.push_back(contact);
+			cell_contacts_cache.insert(atom, cell);
+			++broad_phase_stats.new_contacts_count;
+			objects[atoms.parent[atom]].wake();
+		}
+	}
+
+	// Returns false if the contact's cell is not solid anymore. The body is woken if the cell's open faces changed
+	bool updateCellContact(AtomContact& c)
+	{
+		const int32_t width = grid->getInfo().width;
+		const int32_t cell_x = Tools::as<int32_t>(c.id_b % width);
+		const int32_t cell_y = Tools::as<int32_t>(c.id_b / width);
+		if (!isSolidCell(cell_x, cell_y)) {
+			return false;
+		}
+		const uint8_t solid_neighbours = getSolidNeighbours(cell_x, cell_y);
+		if (solid_neighbours != c.cell_solid_neighbours) {
+			c.cell_solid_neighbours = solid_neighbours;
+			objects[c.body_a].wake();
+		}
+		return true;
+	}
+
+	bool isSolidCell(int32_t x, int32_t y) const
+	{
+		return grid->getCellContentAt(x, y) == 1;
+	}
+
+	// Out of the grid counts as solid so atoms are never pushed out of the world
+	uint8_t getSolidNeighbours(int32_t x, int32_t y) const
+	{
+		const GridInfo info = grid->getInfo();
+		const auto is_solid = [&](int32_t nx, int32_t ny) {
+			return nx < 0 || ny < 0 || nx >= info.width || ny >= info.height || isSolidCell(nx, ny);
+		};
+		return (is_solid(x - 1, y) ? AtomContact::Left : 0) | (is_solid(x + 1, y) ? AtomContact::Right : 0) |
+			   (is_solid(x, y - 1) ? AtomContact::Top : 0) | (is_solid(x, y + 1) ? AtomContact::Bottom : 0);
+	}
+
+	uint64_t getCellIndex(int32_t x, int32_t y) const
+	{
+		return Tools::as<uint64_t>(x) + Tools::as<uint64_t>(y) * Tools::as<uint64_t>(grid->getInfo().width);
+	}
+
+	// Reference implementation, tests every pair of atoms
+	void findContactsBruteForce()
+	{
 		const size_t atoms_count = atoms.size();
 		for (uint64_t i(0); i < atoms_count; ++i) {
+			// Pairs with a sleeping or static atom are found from the other side
+			if (!objects[atoms.parent[i]].isAwake()) {
+				continue;
+			}
 			for (uint64_t k(0); k < atoms_count; ++k) {
-				if (isNewContact(i, k) && atoms[i].parent != atoms[k].parent) {
-					AtomContact contact(i, k);
-					if (contact.isValid(atoms)) {
-						contact.initialize(atoms);
-						atom_contacts.push_back(contact);
-						setContact(i, k);
+				checkContact(i, k);
+			}
+		}
+	}
+
+	void findContactsSpatialHash()
+	{
+		float max_radius = 0.0f;
+		for (float radius : atoms.radius) {
+			max_radius = std::max(max_radius, radius);
+		}
+		// Colliding atoms are at most one cell apart
+		spatial_hash.build(atoms, 2.0f * max_radius);
+
+		const size_t atoms_count = atoms.size();
+		for (uint64_t i(0); i < atoms_count; ++i) {
+			if (!objects[atoms.parent[i]].isAwake()) {
+				continue;
+			}
+			spatial_hash.forEachNeighbour(atoms.getPosition(i), [&](uint64_t k) {
+				// Each pair once, pairs with a sleeping or static atom are only seen from the awake one
+				if (k > i || !objects[atoms.parent[k]].isAwake()) {
+					checkContact(std::min(i, k), std::max(i, k));
+				}
+			});
+		}
+	}
+
+	void findContactsSweepAndPrune()
+	{
+		sweep_and_prune.update(atoms);
+		sweep_and_prune.forEachOverlap([&](uint64_t i, uint64_t k) {
+			checkContact(i, k);
+		});
+	}
+
+	// Bodies are first paired using their fattened boxes, atoms are only tested for overlapping bodies
+	void findContactsAABBTree()
+	{
+		const uint32_t objects_count = objects.size();
+		for (uint32_t i(0); i < objects_count; ++i) {
+			// The grid's body has no atoms, its cells are not in the tree
+			if (!objects.isAlive(i) || objects[i].atoms_ids.empty()) {
+				continue;
+			}
+			ComposedObject& o = objects[i];
+			o.computeAABB(atoms);
+			if (o.proxy_id == objects_tree.null_node) {
+				o.proxy_id = objects_tree.createProxy(o.aabb, i);
+			}
+			else if (o.isAwake()) {
+				objects_tree.moveProxy(o.proxy_id, o.aabb);
+			}
+		}
+
+		for (uint32_t i(0); i < objects_count; ++i) {
+			const ComposedObject& o = objects[i];
+			// Static and sleeping bodies are found from the awake ones
+			if (!objects.isAlive(i) || !o.isAwake()) {
+				continue;
+			}
+			objects_tree.query(objects_tree.getFatAABB(o.proxy_id), [&](uint32_t other_id) {
+				const ComposedObject& other = objects[other_id];
+				if (other_id == i || (other.isAwake() && other_id < i)) {
+					return;
+				}
+				if (o.aabb.overlaps(other.aabb)) {
+					checkObjectsContacts(o, other);
+				}
+			});
+		}
+	}
+
+	void checkObjectsContacts(const ComposedObject& o1, const ComposedObject& o2)
+	{
+		++broad_phase_stats.objects_pairs_count;
+		// Only atoms inside the other body's box can collide
+		getAtomsInAABB(o1, o2.aabb, midphase_atoms_1);
+		getAtomsInAABB(o2, o1.aabb, midphase_atoms_2);
+		for (uint64_t i : midphase_atoms_1) {
+			for (uint64_t k : midphase_atoms_2) {
+				checkContact(std::min(i, k), std::max(i, k));
+			}
+		}
+	}
+
+	void getAtomsInAABB(const ComposedObject& o, const AABB& box, std::vector<uint64_t>& out) const
+	{
+		out.clear();
+		for (uint64_t id : o.atoms_ids) {
+			const Vec2 position = atoms.getPosition(id);
+			const Vec2 r(atoms.radius[id], atoms.radius[id]);
+			if (AABB(position - r, position.plus(r)).overlaps(box)) {
+				out.push_back(id);
+			}
+		}
+	}
+
+	// Lists are only rebuilt when an atom moved more than half the skin, see neighbour_list.getRebuildRate()
+	void findContactsNeighbourList()
+	{
+		neighbour_list.update(atoms);
+		neighbour_list.forEachPair([&](uint64_t i, uint64_t k) {
+			checkContact(i, k);
+		});
+	}
+
+	void checkContact(uint64_t i, uint64_t k)
+	{
+		const uint32_t body_i = atoms.parent[i];
+		const uint32_t body_k = atoms.parent[k];
+		ComposedObject& parent_i = objects[body_i];
+		ComposedObject& parent_k = objects[body_k];
+		if (!parent_i.isAwake() && !parent_k.isAwake()) {
+			return;
+		}
+		++broad_phase_stats.candidates_count;
+		if (isNewContact(i, k) && body_i != body_k) {
+			AtomContact contact(i, k, body_i, body_k);
+			if (contact.isValid(atoms)) {
+				contact.initialize(atoms, objects);
+				atom_contacts.push_back(contact);
+				setContact(i, k);
+				++broad_phase_stats.new_contacts_count;
+				// Something touched a sleeping body
+				parent_i.wake();
+				parent_k.wake();
+			}
+		}
+	}
+
+	bool isContactAwake(const AtomContact& c) const
+	{
+		return objects[c.body_a].isAwake() || objects[c.body_b].isAwake();
+	}
+
+	void buildIslands()
+	{
+		islands.reset(objects.size());
+		for (const AtomContact& c : atom_contacts) {
+			// Static bodies don't propagate anything, they don't link islands
+			if (objects[c.body_a].moving && objects[c.body_b].moving) {
+				islands.link(c.body_a, c.body_b);
+			}
+		}
+		islands.build();
+	}
+
+	// An island falls asleep when all its bodies have been still long enough, it wakes up as soon as one of them moves
+	void updateSleeping()
+	{
+		for (ComposedObject& o : objects) {
+			if (o.isAwake()) {
+				o.updateSleepState(sleep_max_velocity, sleep_max_angular_velocity);
+			}
+		}
+
+		for (uint32_t island(0); island < islands.islands_count; ++island) {
+			bool can_sleep = true;
+			islands.forEachObject(island, [&](uint32_t id) {
+				const ComposedObject& o = objects[id];
+				can_sleep &= (!o.isAwake() || o.still_frames_count >= sleep_frames_count);
+			});
+
+			islands.forEachObject(island, [&](uint32_t id) {
+				ComposedObject& o = objects[id];
+				if (!o.moving || !objects.isAlive(id)) {
+					return;
+				}
+				if (can_sleep && !o.sleeping) {
+					o.sleep();
+				}
+				else if (!can_sleep && o.sleeping) {
+					o.wake();
+				}
+			});
+		}
+	}
+
+	void solveSequential()
+	{
+		const uint32_t max_iterations_count = iterations_settings.getMaxIterationsCount();
+		for (uint32_t i(0); i < max_iterations_count; ++i) {
+			float residual = 0.0f;
+			for (AtomContact& c : atom_contacts) {
+				if (isContactAwake(c)) {
+					residual = std::max(residual, c.computeImpulse(objects));
+				}
+			}
+			convergence_stats.iterations_count = i + 1;
+			convergence_stats.residual = residual;
+			if (iterations_settings.isConverged(i + 1, residual)) {
+				break;
+			}
+		}
+	}
+
+	// Islands don't share any moving body so each one can be solved on its own thread without locks.
+	// In adaptive mode each island stops iterating as soon as it has converged
+	void solveIslandsParallel()
+	{
+		const uint32_t islands_count = islands.islands_count;
+		islands_contacts_offsets = frame_arena.allocate<uint32_t>(islands_count + 1, 0);
+		for (const AtomContact& c : atom_contacts) {
+			if (isContactAwake(c)) {
+				++islands_contacts_offsets[getContactIsland(c) + 1];
+			}
+		}
+		for (uint32_t i(0); i < islands_count; ++i) {
+			islands_contacts_offsets[i + 1] += islands_contacts_offsets[i];
+		}
+		islands_contacts = frame_arena.allocate<AtomContact*>(islands_contacts_offsets[islands_count]);
+		islands_cursors = frame_arena.allocate<uint32_t>(islands_count);
+		std::copy(islands_contacts_offsets.begin(), islands_contacts_offsets.end() - 1, islands_cursors.begin());
+		for (AtomContact& c : atom_contacts) {
+			if (isContactAwake(c)) {
+				islands_contacts[islands_cursors[getContactIsland(c)]++] = &c;
+			}
+		}
+
+		// Biggest islands are scheduled first so that they don't end up running alone at the end
+		uint32_t solved_islands_count = 0;
+		for (uint32_t i(0); i < islands_count; ++i) {
+			solved_islands_count += (getIslandContactsCount(i) > 0);
+		}
+		islands_order = frame_arena.allocate<uint32_t>(solved_islands_count);
+		solved_islands_count = 0;
+		for (uint32_t i(0); i < islands_count; ++i) {
+			if (getIslandContactsCount(i)) {
+				islands_order[solved_islands_count++] = i;
+			}
+		}
+		std::sort(islands_order.begin(), islands_order.end(), [&](uint32_t i1, uint32_t i2) {
+			return getIslandContactsCount(i1) > getIslandContactsCount(i2);
+		});
+
+		islands_convergence = frame_arena.allocate<ConvergenceStats>(solved_islands_count);
+		const uint32_t max_iterations_count = iterations_settings.getMaxIterationsCount();
+		getThreadPool().parallelFor(solved_islands_count, [&](uint32_t i) {
+			const uint32_t island = islands_order[i];
+			ConvergenceStats& stats = islands_convergence[i];
+			stats = ConvergenceStats();
+			for (uint32_t k(0); k < max_iterations_count; ++k) {
+				float residual = 0.0f;
+				for (uint32_t c(islands_contacts_offsets[island]); c < islands_contacts_offsets[island + 1]; ++c) {
+					residual = std::max(residual, islands_contacts[c]->computeImpulse(objects));
+				}
+				stats.iterations_count = k + 1;
+				stats.residual = residual;
+				if (iterations_settings.isConverged(k + 1, residual)) {
+					break;
+				}
+			}
+		});
+
+		for (const ConvergenceStats& stats : islands_convergence) {
+			convergence_stats.iterations_count = std::max(convergence_stats.iterations_count, stats.iterations_count);
+			convergence_stats.residual = std::max(convergence_stats.residual, stats.residual);
+		}
+	}
+
+	// Contacts of a same color share no moving body, each color is solved in parallel with a barrier
+	// between colors. It's still Gauss-Seidel, only the order in which contacts are solved changes
+	void solveGraphColoring()
+	{
+		colorContacts();
+		ThreadPool& pool = getThreadPool();
+		const uint32_t chunk_size = 64;
+		// Each chunk reports its residual, they are gathered after each color
+		ArenaArray<float> chunks_residuals = frame_arena.allocate<float>(colors_offsets[colors_count] / chunk_size + 1);
+		const uint32_t max_iterations_count = iterations_settings.getMaxIterationsCount();
+		for (uint32_t k(0); k < max_iterations_count; ++k) {
+			float residual = 0.0f;
+			for (uint32_t color(0); color < colors_count; ++color) {
+				const uint32_t begin = colors_offsets[color];
+				const uint32_t end = colors_offsets[color + 1];
+				// Contacts that didn't get a color are solved sequentially
+				if (color == max_colors_count) {
+					for (uint32_t c(begin); c < end; ++c) {
+						residual = std::max(residual, colored_contacts[c]->computeImpulse(objects));
+					}
+					continue;
+				}
+				const uint32_t chunks_count = (end - begin + chunk_size - 1) / chunk_size;
+				pool.parallelFor(chunks_count, [&](uint32_t chunk) {
+					const uint32_t chunk_end = std::min(end, begin + (chunk + 1) * chunk_size);
+					float chunk_residual = 0.0f;
+					for (uint32_t c(begin + chunk * chunk_size); c < chunk_end; ++c) {
+						chunk_residual = std::max(chunk_residual, colored_contacts[c]->computeImpulse(objects));
 					}
+					chunks_residuals[chunk] = chunk_residual;
+				});
+				for (uint32_t chunk(0); chunk < chunks_count; ++chunk) {
+					residual = std::max(residual, chunks_residuals[chunk]);
 				}
 			}
+			convergence_stats.iterations_count = k + 1;
+			convergence_stats.residual = residual;
+			if (iterations_settings.isConverged(k + 1, residual)) {
+				break;
+			}
 		}
 	}
 
+	// Greedy coloring, each contact takes the first color not used yet by its moving bodies
+	void colorContacts()
+	{
+		objects_colors = frame_arena.allocate<uint64_t>(objects.size(), 0);
+		contacts_colors = frame_arena.allocate<uint8_t>(static_cast<uint32_t>(atom_contacts.size()));
+		colors_offsets = frame_arena.allocate<uint32_t>(max_colors_count + 2, 0);
+		colors_count = 0;
+		uint32_t awake_contacts_count = 0;
+		for (const AtomContact& c : atom_contacts) {
+			if (!isContactAwake(c)) {
+				continue;
+			}
+			const uint64_t used_colors = getObjectColors(c.body_a) | getObjectColors(c.body_b);
+			uint32_t color = 0;
+			while (color < max_colors_count && (used_colors & (1ull << color))) {
+				++color;
+			}
+			if (color < max_colors_count) {
+				const uint64_t color_bit = 1ull << color;
+				if (objects[c.body_a].moving) {
+					objects_colors[c.body_a] |= color_bit;
+				}
+				if (objects[c.body_b].moving) {
+					objects_colors[c.body_b] |= color_bit;
+				}
+			}
+			contacts_colors[awake_contacts_count++] = static_cast<uint8_t>(color);
+			++colors_offsets[color + 1];
+			colors_count = std::max(colors_count, color + 1);
+		}
+
+		for (uint32_t i(0); i < colors_count; ++i) {
+			colors_offsets[i + 1] += colors_offsets[i];
+		}
+		colored_contacts = frame_arena.allocate<AtomContact*>(colors_offsets[colors_count]);
+		colors_cursors = frame_arena.allocate<uint32_t>(colors_count);
+		std::copy(colors_offsets.begin(), colors_offsets.begin() + colors_count, colors_cursors.begin());
+		uint64_t i = 0;
+		for (AtomContact& c : atom_contacts) {
+			if (isContactAwake(c)) {
+				colored_contacts[colors_cursors[contacts_colors[i++]]++] = &c;
+			}
+		}
+	}
+
+	uint64_t getObjectColors(uint32_t body) const
+	{
+		return objects[body].moving ? objects_colors[body] : 0;
+	}
+
+	uint32_t getContactIsland(const AtomContact& c) const
+	{
+		const uint32_t body = objects[c.body_a].moving ? c.body_a : c.body_b;
+		return islands.objects_island[body];
+	}
+
+	uint32_t getIslandContactsCount(uint32_t island) const
+	{
+		return islands_contacts_offsets[island + 1] - islands_contacts_offsets[island];
+	}
+
+	ThreadPool& getThreadPool()
+	{
+		if (!thread_pool) {
+			thread_pool.reset(new ThreadPool(threads_count));
+		}
+		return *thread_pool;
+	}
+
 	void applyGravity()
 	{
 		const Vec2 gravity(0.0f, 500.0f);
 		for (ComposedObject& o : objects) {
-			o.accelerate(gravity);
+			if (o.isAwake()) {
+				o.accelerate(gravity);
+			}
 		}
 	}
 
 	void update(float dt)
 	{
+		Clock::time_point phase_start = Clock::now();
+		frame_arena.reset();
+		updateLocalOffsets();
 		applyGravity();
 
 		for (ComposedObject& o : objects) {
 			o.update(dt);
 		}
+		step_timings.integration_ns = getPhaseTime(phase_start);
 
 		findContacts();
-		const uint32_t iterations_count = 8;
-		for (uint32_t i(iterations_count); i--;) {
-			for (AtomContact& c : atom_contacts) {
-				c.computeImpulse(atoms);
-			}
+		step_timings.contacts_ns = getPhaseTime(phase_start);
+		buildIslands();
+		step_timings.islands_ns = getPhaseTime(phase_start);
+
+		convergence_stats = ConvergenceStats();
+		switch (solve_mode) {
+		case SolveMode::Sequential:
+			solveSequential();
+			break;
+		case SolveMode::IslandsParallel:
+			solveIslandsParallel();
+			break;
+		case SolveMode::GraphColoring:
+			solveGraphColoring();
+			break;
+		case SolveMode::SIMDLanes:
+			colorContacts();
+			convergence_stats = lanes_solver.solve(colored_contacts.data, colors_offsets.data, colors_count, max_colors_count, objects, iterations_settings);
+			break;
+		}
+		step_timings.solve_ns = getPhaseTime(phase_start);
+
+		for (ComposedObject& o : objects) {
+			o.updateState(dt);
+		}
+		updateAtomsPositions();
+		step_timings.positions_ns = getPhaseTime(phase_start);
+
+		if (allow_sleeping) {
+			updateSleeping();
 		}
+		step_timings.sleeping_ns = getPhaseTime(phase_start);
+	}
 
+	// Objects built atom by atom get their local offsets once, before they first move
+	void updateLocalOffsets()
+	{
 		for (ComposedObject& o : objects) {
-			o.updateState(dt, atoms);
+			if (o.local_offsets_outdated) {
+				o.computeLocalOffsets(atoms);
+				o.local_offsets_outdated = false;
+			}
 		}
 	}
 
+	// Derives all atoms world positions from their local offsets in a single pass
+	void updateAtomsPositions()
+	{
+		const uint32_t objects_count = objects.size();
+		ArenaArray<float> origins_x = frame_arena.allocate<float>(objects_count);
+		ArenaArray<float> origins_y = frame_arena.allocate<float>(objects_count);
+		ArenaArray<float> cosines   = frame_arena.allocate<float>(objects_count);
+		ArenaArray<float> sines     = frame_arena.allocate<float>(objects_count);
+		for (uint32_t i(0); i < objects_count; ++i) {
+			const ComposedObject& o = objects[i];
+			origins_x[i] = o.center_of_mass.x;
+			origins_y[i] = o.center_of_mass.y;
+			cosines[i]   = o.rotation.x;
+			sines[i]     = o.rotation.y;
+		}
+
+		const uint64_t atoms_count = atoms.size();
+		const uint32_t* parents = atoms.parent.data();
+		const float* local_x = atoms.local_x.data();
+		const float* local_y = atoms.local_y.data();
+		float* x = atoms.x.data();
+		float* y = atoms.y.data();
+		for (uint64_t i(0); i < atoms_count; ++i) {
+			const uint32_t p = parents[i];
+			x[i] = origins_x[p] + cosines[p] * local_x[i] - sines[p] * local_y[i];
+			y[i] = origins_y[p] + sines[p] * local_x[i] + cosines[p] * local_y[i];
+		}
+	}
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Returns the time since phase_start and starts the next phase
+	static uint64_t getPhaseTime(Clock::time_point& phase_start)
+	{
+		const Clock::time_point now = Clock::now();
+		const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - phase_start).count();
+		phase_start = now;
+		return elapsed;
+	}
+
+	ComposedObject& addObject()
+	{
+		last_object = objects.add();
+		return objects[last_object.index];
+	}
+
 	void addAtomToLastObject(const Vec2& position, float mass=1.0f)
 	{
-		atoms.emplace_back(position);
-		objects.back().addAtom(atoms.size() - 1, atoms);
+		atoms.add(Atom(position, mass, last_object.index));
+		objects[last_object.index].addAtom(atoms.size() - 1, atoms);
+	}
+
+	// Builds a whole object from atoms positioned relative to position, all with the default radius as contacts
+	// expect. Masses can be empty for atoms of mass 1, otherwise there is one per atom. The storages grow once and
+	// the mass properties are the same as adding the atoms one by one
+	ComposedObject& addObject(const Vec2& position, const std::vector<Vec2>& local_positions, const std::vector<float>& masses = {})
+	{
+		assert(masses.empty() || masses.size() == local_positions.size());
+		ComposedObject& object = addObject();
+		atoms.reserveMore(local_positions.size());
+		object.atoms_ids.reserve(local_positions.size());
+		for (uint64_t i(0); i < local_positions.size(); ++i) {
+			addAtomToLastObject(position.plus(local_positions[i]), (i < masses.size()) ? masses[i] : 1.0f);
+		}
+		return object;
 	}
 
-	std::vector<Atom> atoms;
-	std::list<ComposedObject> objects;
-	std::list<AtomContact> atom_contacts;
+	AtomStorage atoms;
+	ObjectContainer objects;
+	SlotHandle last_object;
+	std::vector<AtomContact> atom_contacts;
+
+	PairCache contacts_cache;
+	// Pairs of atom and cell index, apart from contacts_cache since cells indices overlap atoms ids
+	AtomCellCache cell_contacts_cache;
+	// Solid cells collide with atoms, owned by the caller
+	const Grid* grid;
+	uint64_t grid_version;
+	// Static body without atoms that cells contacts use as their second body
+	SlotHandle grid_body;
+
+	BroadPhase broad_phase;
+	BroadPhaseStats broad_phase_stats;
+	StepTimings step_timings;
+	SpatialHash spatial_hash;
+	SweepAndPrune sweep_and_prune;
+	AABBTree<uint32_t> objects_tree;
+	std::vector<uint64_t> midphase_atoms_1;
+	std::vector<uint64_t> midphase_atoms_2;
+	NeighbourList neighbour_list;
+
+	Islands islands;
+
+	SolveMode solve_mode;
+	IterationsSettings iterations_settings;
+	ConvergenceStats convergence_stats;
+	// 0 uses all the hardware threads
+	uint32_t threads_count;
+	std::unique_ptr<ThreadPool> thread_pool;
+	// Per step data, allocated from the frame arena
+	FrameArena frame_arena;
+	ArenaArray<uint32_t> islands_contacts_offsets;
+	ArenaArray<uint32_t> islands_cursors;
+	ArenaArray<AtomContact*> islands_contacts;
+	ArenaArray<uint32_t> islands_order;
+	ArenaArray<ConvergenceStats> islands_convergence;
+
+	static constexpr uint32_t max_colors_count = 64;
+	uint32_t colors_count;
+	ArenaArray<uint64_t> objects_colors;
+	ArenaArray<uint8_t> contacts_colors;
+	ArenaArray<uint32_t> colors_offsets;
+	ArenaArray<uint32_t> colors_cursors;
+	ArenaArray<AtomContact*> colored_contacts;
+	ContactLanesSolver lanes_solver;
 
-	std::vector<std::vector<uint64_t>> contacts_states;
+	bool allow_sleeping;
+	float sleep_max_velocity;
+	float sleep_max_angular_velocity;
+	uint32_t sleep_frames_count;
 
 	const Vec2 boundaries_min = Vec2(50.0f, 50.0f);
 	const Vec2 boundaries_max = Vec2(1550.0f, 850.0f);
@@ -1,6 +1,11 @@
 #pragma once
 #include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
 #include "vec.hpp"
+#include "aabb_tree.hpp"
+#include "slot_map.hpp"
 
 
 struct ComposedObject;
@@ -24,35 +29,91 @@ struct Atom
 {
 	Atom()
 		: position()
-		, last_position()
-		, acceleration()
+		, radius(8.0f)
 		, mass(1.0f)
-		, parent(nullptr)
+		, parent(0)
 	{}
 
-	Atom(const Vec2& p)
+	Atom(const Vec2& p, float m = 1.0f, uint32_t parent_ = 0)
 		: position(p)
-		, last_position(p)
-		, acceleration()
-		, mass(1.0f)
-		, parent(nullptr)
+		, radius(8.0f)
+		, mass(m)
+		, parent(parent_)
 	{}
 
-	void reset()
+	Vec2 position;
+	float radius;
+	float mass;
+	// Index of the parent object in the solver
+	uint32_t parent;
+};
+
+
+// Atoms are stored as separate arrays so that hot loops only read what they need
+struct AtomStorage
+{
+	void add(const Atom& atom)
 	{
-		acceleration = {};
+		x.push_back(atom.position.x);
+		y.push_back(atom.position.y);
+		radius.push_back(atom.radius);
+		mass.push_back(atom.mass);
+		parent.push_back(atom.parent);
+		local_x.push_back(0.0f);
+		local_y.push_back(0.0f);
 	}
 
-	Vec2 getVelocity() const
+	void reserve(uint64_t count)
 	{
-		return position - last_position;
+		x.reserve(count);
+		y.reserve(count);
+		radius.reserve(count);
+		mass.reserve(count);
+		parent.reserve(count);
+		local_x.reserve(count);
+		local_y.reserve(count);
 	}
 
-	ComposedObject* parent;
-	Vec2 position, last_position;
-	Vec2 acceleration;
-	float mass;
-	float radius = 8.0f;
+	// Room for count more atoms, grows geometrically so that adding objects one after the other stays linear
+	void reserveMore(uint64_t count)
+	{
+		const uint64_t required = size() + count;
+		if (required > x.capacity()) {
+			reserve(std::max(required, 2 * x.capacity()));
+		}
+	}
+
+	uint64_t size() const
+	{
+		return x.size();
+	}
+
+	Vec2 getPosition(uint64_t i) const
+	{
+		return Vec2(x[i], y[i]);
+	}
+
+	void setPosition(uint64_t i, const Vec2& position)
+	{
+		x[i] = position.x;
+		y[i] = position.y;
+	}
+
+	Atom get(uint64_t i) const
+	{
+		Atom atom(getPosition(i), mass[i], parent[i]);
+		atom.radius = radius[i];
+		return atom;
+	}
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> radius;
+	std::vector<float> mass;
+	std::vector<uint32_t> parent;
+	// Offset from the parent's center of mass in the parent's frame, world positions are derived from it
+	std::vector<float> local_x;
+	std::vector<float> local_y;
 };
 
 
@@ -61,47 +122,56 @@ struct ComposedObject
 	ComposedObject()
 		: center_of_mass()
 		, velocity()
+		, applied_force(0.0f, 0.0f)
 		, angular_velocity(0.0f)
 		, angle(0.0f)
-		, applied_force(0.0f, 0.0f)
-		, intertia(0.0f)
+		, rotation(1.0f, 0.0f)
 		, mass(0.0f)
+		, intertia(0.0f)
 		, moving(true)
+		, sleeping(false)
+		, still_frames_count(0)
+		, local_offsets_outdated(false)
+		, proxy_id(AABBTree<uint32_t>::null_node)
 	{}
 
-	void addAtom(uint64_t id, std::vector<Atom>& atoms)
+	// The inertia is kept about the center of mass, the first atom adds its own mass to it
+	void addAtom(uint64_t id, AtomStorage& atoms)
 	{
 		atoms_ids.push_back(id);
-		Atom& new_atom = atoms[id];
-		new_atom.parent = this;
-		if (!mass) {
-			intertia = new_atom.mass;
+		const float atom_mass = atoms.mass[id];
+		const Vec2 position = atoms.getPosition(id);
+		const float new_mass = mass + atom_mass;
+		if (atoms_ids.size() == 1) {
+			intertia = atom_mass;
+			center_of_mass = position;
 		}
-		else {
-			addToInertia(new_atom);
+		else if (new_mass > 0.0f) {
+			// Parallel axis theorem, the center of mass moves toward the new atom
+			const Vec2 to_atom = position - center_of_mass;
+			intertia += mass * atom_mass / new_mass * to_atom.getLength2();
+			center_of_mass += to_atom * (atom_mass / new_mass);
 		}
-		mass += new_atom.mass;
-		computeCenterOfMass(atoms);
+		mass = new_mass;
+		// Computed once the object is complete, see Solver::updateLocalOffsets
+		local_offsets_outdated = true;
 	}
 
-	void computeCenterOfMass(std::vector<Atom>& atoms)
+	// Expresses the current world positions of the atoms in the object's frame
+	void computeLocalOffsets(AtomStorage& atoms) const
 	{
-		Vec2 com;
 		for (uint64_t id : atoms_ids) {
-			com += atoms[id].position;
+			const float dx = atoms.x[id] - center_of_mass.x;
+			const float dy = atoms.y[id] - center_of_mass.y;
+			atoms.local_x[id] =  rotation.x * dx + rotation.y * dy;
+			atoms.local_y[id] = -rotation.y * dx + rotation.x * dy;
 		}
-		center_of_mass = com / mass;
-	}
-
-	void addToInertia(const Atom& a)
-	{
-		const Vec2 r = center_of_mass - a.position;
-		intertia += a.mass * r.getLength2();
 	}
 
 	void applyForce(const Vec2& f)
 	{
 		applied_force += f;
+		wake();
 	}
 
 	void accelerate(const Vec2& a)
@@ -114,9 +184,40 @@ struct ComposedObject
 		return mass;
 	}
 
+	bool isAwake() const
+	{
+		return moving && !sleeping;
+	}
+
+	void wake()
+	{
+		if (sleeping) {
+			sleeping = false;
+			still_frames_count = 0;
+		}
+	}
+
+	void sleep()
+	{
+		sleeping = true;
+		velocity = Vec2(0.0f, 0.0f);
+		angular_velocity = 0.0f;
+		applied_force = Vec2(0.0f, 0.0f);
+	}
+
+	void updateSleepState(float max_velocity, float max_angular_velocity)
+	{
+		if (velocity.getLength2() < max_velocity * max_velocity && std::abs(angular_velocity) < max_angular_velocity) {
+			++still_frames_count;
+		}
+		else {
+			still_frames_count = 0;
+		}
+	}
+
 	void update(float dt)
 	{
-		if (!moving) {
+		if (!isAwake()) {
 			return;
 		}
 		// Need to add moment
@@ -125,15 +226,15 @@ struct ComposedObject
 		applied_force = Vec2(0.0f, 0.0f);
 	}
 
-	void updateState(float dt, std::vector<Atom>& atoms)
+	// Atoms positions are updated afterwards from the new transform
+	void updateState(float dt)
 	{
-		if (!moving) {
+		if (!isAwake()) {
 			return;
 		}
-		translate(velocity * dt, atoms);
 		center_of_mass += velocity * dt;
-		rotate(angular_velocity * dt, atoms);
 		angle += angular_velocity * dt;
+		rotation = Vec2(std::cos(angle), std::sin(angle));
 	}
 
 	float getMomentInertia() const
@@ -141,20 +242,6 @@ struct ComposedObject
 		return intertia;
 	}
 
-	void translate(const Vec2& v, std::vector<Atom>& atoms)
-	{
-		for (uint64_t a_id : atoms_ids) {
-			atoms[a_id].position += v;
-		}
-	}
-
-	void rotate(float r, std::vector<Atom>& atoms)
-	{
-		for (uint64_t a_id : atoms_ids) {
-			atoms[a_id].position.rotate(center_of_mass, r);
-		}
-	}
-
 	float getDistanceToCenterOfMass(const Vec2& p) const
 	{
 		return (center_of_mass - p).getLength();
@@ -170,15 +257,29 @@ struct ComposedObject
 		return angular_velocity * float(moving);
 	}
 
-	Vec2 getAtomNextPosition(const Atom* a) const
+	Vec2 getAtomNextPosition(const Vec2& position) const
 	{
 		const float dt = 0.016f;
 		const Vec2 next_com = center_of_mass.plus(velocity * dt);
-		Vec2 next_position = a->position.plus(velocity * dt);
+		Vec2 next_position = position.plus(velocity * dt);
 		next_position.rotate(next_com, angular_velocity * dt);
 		return next_position;
 	}
 
+	void computeAABB(const AtomStorage& atoms)
+	{
+		Vec2 box_min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		Vec2 box_max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+		for (uint64_t id : atoms_ids) {
+			const float radius = atoms.radius[id];
+			box_min.x = std::min(box_min.x, atoms.x[id] - radius);
+			box_min.y = std::min(box_min.y, atoms.y[id] - radius);
+			box_max.x = std::max(box_max.x, atoms.x[id] + radius);
+			box_max.y = std::max(box_max.y, atoms.y[id] + radius);
+		}
+		aabb = AABB(box_min, box_max);
+	}
+
 	std::vector<uint64_t> atoms_ids;
 	Vec2 center_of_mass;
 	Vec2 velocity;
@@ -186,9 +287,22 @@ struct ComposedObject
 
 	float angular_velocity;
 	float angle;
+	// Cosine and sine of the angle
+	Vec2 rotation;
 
 	float mass;
 	float intertia;
 
 	bool moving;
+	bool sleeping;
+	uint32_t still_frames_count;
+	// Set when atoms were added since the last computeLocalOffsets
+	bool local_offsets_outdated;
+
+	AABB aabb;
+	int32_t proxy_id;
 };
+
+
+// Atoms and contacts refer to objects by slot index
+using ObjectContainer = SlotMap<ComposedObject>;
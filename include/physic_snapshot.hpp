@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "physic.hpp"
+
+
+struct ContactDebug
+{
+	ContactDebug() = default;
+
+	ContactDebug(const AtomContact& contact)
+		: id_a(contact.id_a)
+		, id_b(contact.id_b)
+		, with_cell(contact.with_cell)
+		, point(contact.contact_point)
+		, impulse(contact.impulse)
+		, tick_count(contact.tick_count)
+	{}
+
+	uint64_t id_a;
+	// id_b is a cell index for contacts with the grid
+	uint64_t id_b;
+	bool with_cell;
+	Vec2 point;
+	Vec2 impulse;
+	uint32_t tick_count;
+};
+
+
+// Immutable copy of what is needed to draw one physic step, positions before the step are kept for interpolation
+struct PhysicSnapshot
+{
+	typedef std::chrono::steady_clock Clock;
+
+	PhysicSnapshot()
+		: step_id(0)
+		, dt(0.0f)
+	{}
+
+	uint64_t size() const
+	{
+		return x.size();
+	}
+
+	// ratio is 0 for the previous step and 1 for this one
+	Vec2 getPosition(uint64_t i, float ratio) const
+	{
+		return Vec2(previous_x[i] + (x[i] - previous_x[i]) * ratio,
+		            previous_y[i] + (y[i] - previous_y[i]) * ratio);
+	}
+
+	// Ratio to use at the given time, the snapshot is fully reached one step after it was published
+	float getInterpolationRatio(Clock::time_point now) const
+	{
+		if (dt <= 0.0f) {
+			return 1.0f;
+		}
+		const float elapsed = std::chrono::duration<float>(now - publish_time).count();
+		return std::min(1.0f, std::max(0.0f, elapsed / dt));
+	}
+
+	std::vector<float> previous_x;
+	std::vector<float> previous_y;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> radius;
+	std::vector<uint32_t> parent;
+	std::vector<ContactDebug> contacts;
+
+	uint64_t step_id;
+	float dt;
+	Clock::time_point publish_time;
+};
+
+
+// Lock free triple buffer, the writer never waits for the reader and the reader always gets the latest complete snapshot
+struct SnapshotBuffer
+{
+	SnapshotBuffer()
+		: back_index(0)
+		, ready_state(1)
+		, front_index(2)
+	{}
+
+	// Writer side
+	PhysicSnapshot& getBack()
+	{
+		return buffers[back_index];
+	}
+
+	void publish()
+	{
+		back_index = ready_state.exchange(back_index | fresh_flag, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// Reader side, the returned snapshot stays untouched until the next call
+	const PhysicSnapshot& acquire()
+	{
+		if (ready_state.load(std::memory_order_relaxed) & fresh_flag) {
+			front_index = ready_state.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+		}
+		return buffers[front_index];
+	}
+
+private:
+	static constexpr uint32_t index_mask = 3;
+	static constexpr uint32_t fresh_flag = 4;
+
+	PhysicSnapshot buffers[3];
+	uint32_t back_index;
+	std::atomic<uint32_t> ready_state;
+	uint32_t front_index;
+};
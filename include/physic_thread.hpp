@@ -0,0 +1,121 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "physic.hpp"
+#include "physic_snapshot.hpp"
+
+
+// Steps the solver at a fixed rate on its own thread and publishes a snapshot after each step.
+// The solver must only be accessed through post while the thread runs
+struct PhysicThread
+{
+	typedef std::chrono::steady_clock Clock;
+	using Command = std::function<void(Solver&)>;
+
+	PhysicThread(Solver& solver_, float dt_)
+		: solver(solver_)
+		, dt(dt_)
+		, stop(false)
+	{
+		worker = std::thread([this]() { run(); });
+	}
+
+	PhysicThread(const PhysicThread&) = delete;
+	PhysicThread& operator=(const PhysicThread&) = delete;
+
+	// Commands posted after the last step are applied here so they are not lost
+	~PhysicThread()
+	{
+		stop = true;
+		worker.join();
+		executeCommands();
+	}
+
+	// Command executed on the physic thread before the next step
+	void post(Command command)
+	{
+		std::lock_guard<std::mutex> lock(commands_mutex);
+		commands.push_back(std::move(command));
+	}
+
+	const PhysicSnapshot& getSnapshot()
+	{
+		return snapshots.acquire();
+	}
+
+private:
+	Solver& solver;
+	const float dt;
+	std::atomic<bool> stop;
+	std::thread worker;
+
+	std::mutex commands_mutex;
+	std::vector<Command> commands;
+	std::vector<Command> pending_commands;
+
+	SnapshotBuffer snapshots;
+	std::vector<float> last_x;
+	std::vector<float> last_y;
+	uint64_t step_id = 0;
+
+	void run()
+	{
+		const Clock::duration step_duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(dt));
+		Clock::time_point next_step = Clock::now();
+		while (!stop) {
+			executeCommands();
+			solver.update(dt);
+			publish();
+
+			next_step += step_duration;
+			const Clock::time_point now = Clock::now();
+			if (next_step < now) {
+				// Too slow to keep up, don't try to catch up
+				next_step = now;
+			}
+			std::this_thread::sleep_until(next_step);
+		}
+	}
+
+	void executeCommands()
+	{
+		{
+			std::lock_guard<std::mutex> lock(commands_mutex);
+			pending_commands.swap(commands);
+		}
+		for (Command& command : pending_commands) {
+			command(solver);
+		}
+		pending_commands.clear();
+	}
+
+	void publish()
+	{
+		const AtomStorage& atoms = solver.atoms;
+		// Atoms added since the last step have no previous position
+		for (uint64_t i(last_x.size()); i < atoms.size(); ++i) {
+			last_x.push_back(atoms.x[i]);
+			last_y.push_back(atoms.y[i]);
+		}
+
+		PhysicSnapshot& snapshot = snapshots.getBack();
+		snapshot.previous_x.assign(last_x.begin(), last_x.end());
+		snapshot.previous_y.assign(last_y.begin(), last_y.end());
+		snapshot.x.assign(atoms.x.begin(), atoms.x.end());
+		snapshot.y.assign(atoms.y.begin(), atoms.y.end());
+		snapshot.radius.assign(atoms.radius.begin(), atoms.radius.end());
+		snapshot.parent.assign(atoms.parent.begin(), atoms.parent.end());
+		snapshot.contacts.assign(solver.atom_contacts.begin(), solver.atom_contacts.end());
+		snapshot.step_id = ++step_id;
+		snapshot.dt = dt;
+		snapshot.publish_time = Clock::now();
+		snapshots.publish();
+
+		last_x.assign(atoms.x.begin(), atoms.x.end());
+		last_y.assign(atoms.y.begin(), atoms.y.end());
+	}
+};
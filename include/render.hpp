@@ -1,69 +1,414 @@
 #pragma once
 #include <SFML/Graphics.hpp>
+#include <cmath>
+#include <algorithm>
 #include "grid.hpp"
 #include "physic.hpp"
+#include "physic_snapshot.hpp"
+#include "circle_batch.hpp"
+
+
+// Visible part of the world, used to skip what is off screen
+struct RenderView
+{
+	RenderView(const sf::FloatRect& world_rect, float zoom_)
+		: min_x(world_rect.left)
+		, min_y(world_rect.top)
+		, max_x(world_rect.left + world_rect.width)
+		, max_y(world_rect.top + world_rect.height)
+		, zoom(zoom_)
+	{}
+
+	bool isVisible(float x, float y, float radius) const
+	{
+		return x + radius >= min_x && x - radius <= max_x && y + radius >= min_y && y - radius <= max_y;
+	}
+
+	bool isVisible(float box_min_x, float box_min_y, float box_max_x, float box_max_y) const
+	{
+		return box_max_x >= min_x && box_min_x <= max_x && box_max_y >= min_y && box_min_y <= max_y;
+	}
+
+	float min_x, min_y;
+	float max_x, max_y;
+	// Screen pixels per world unit
+	float zoom;
+};
 
 
 struct Renderer
 {
-	static void renderGrid(sf::RenderTarget& target, const Grid& grid, const sf::RenderStates& rs)
+	template<typename TContact>
+	static void renderContacts(sf::RenderTarget& target, const std::vector<TContact>& contacts, const RenderView& view, const sf::RenderStates& rs)
+	{
+		std::vector<sf::Vertex> impulses;
+		impulses.reserve(2 * contacts.size());
+		for (const TContact& contact : contacts) {
+			const ContactDebug c(contact);
+			const Vec2 end = c.point.plus(c.impulse);
+			if (!view.isVisible(std::min(c.point.x, end.x), std::min(c.point.y, end.y), std::max(c.point.x, end.x), std::max(c.point.y, end.y))) {
+				continue;
+			}
+
+			const sf::Color color = c.tick_count > 10 ? sf::Color::Blue : sf::Color::Red;
+			impulses.emplace_back(sf::Vector2f(c.point.x, c.point.y), color);
+			impulses.emplace_back(sf::Vector2f(end.x, end.y), color);
+		}
+
+		if (!impulses.empty()) {
+			target.draw(impulses.data(), impulses.size(), sf::Lines, rs);
+		}
+	}
+};
+
+
+enum class AtomColoring
+{
+	Uniform,
+	Body,
+	Contact,
+};
+
+
+// Draws the visible atoms with a single draw call, the batch is updated in place every frame.
+// Atoms too small on screen are drawn as points
+struct AtomsRenderer
+{
+	AtomsRenderer()
+		: coloring(AtomColoring::Uniform)
+		, min_circle_screen_radius(1.5f)
+		, circles_count(0)
+		, points_count(0)
+	{}
+
+	void render(sf::RenderTarget& target, const Solver& solver, const RenderView& view, const sf::RenderStates& rs)
+	{
+		const AtomStorage& atoms = solver.atoms;
+		markContacts(solver.atom_contacts, atoms.size());
+		begin(atoms.size());
+		for (uint64_t i(0); i < atoms.size(); ++i) {
+			addAtom(view, i, atoms.x[i], atoms.y[i], atoms.radius[i], atoms.parent[i]);
+		}
+		end(target, rs);
+	}
+
+	// Positions are interpolated between the snapshot's previous and current step
+	void render(sf::RenderTarget& target, const PhysicSnapshot& snapshot, float ratio, const RenderView& view, const sf::RenderStates& rs)
+	{
+		markContacts(snapshot.contacts, snapshot.size());
+		begin(snapshot.size());
+		for (uint64_t i(0); i < snapshot.size(); ++i) {
+			const Vec2 position = snapshot.getPosition(i, ratio);
+			addAtom(view, i, position.x, position.y, snapshot.radius[i], snapshot.parent[i]);
+		}
+		end(target, rs);
+	}
+
+	AtomColoring coloring;
+	float min_circle_screen_radius;
+
+private:
+	CircleBatch batch;
+	std::vector<sf::Vertex> points;
+	uint64_t circles_count;
+	uint64_t points_count;
+	std::vector<uint8_t> in_contact;
+
+	void begin(uint64_t atoms_count)
+	{
+		batch.resize(atoms_count);
+		if (points.size() < atoms_count) {
+			points.resize(atoms_count);
+		}
+		circles_count = 0;
+		points_count = 0;
+	}
+
+	void addAtom(const RenderView& view, uint64_t i, float x, float y, float radius, uint32_t parent)
+	{
+		if (!view.isVisible(x, y, radius)) {
+			return;
+		}
+		const sf::Color color = getColor(i, parent);
+		if (radius * view.zoom < min_circle_screen_radius) {
+			points[points_count++] = sf::Vertex(sf::Vector2f(x, y), color);
+		}
+		else {
+			batch.set(circles_count++, x, y, radius, color);
+		}
+	}
+
+	void end(sf::RenderTarget& target, const sf::RenderStates& rs)
+	{
+		batch.resize(circles_count);
+		batch.draw(target, rs);
+		if (points_count) {
+			target.draw(points.data(), points_count, sf::Points, rs);
+		}
+	}
+
+	template<typename TContact>
+	void markContacts(const std::vector<TContact>& contacts, uint64_t atoms_count)
+	{
+		if (coloring != AtomColoring::Contact) {
+			return;
+		}
+		in_contact.assign(atoms_count, 0);
+		for (const TContact& c : contacts) {
+			in_contact[c.id_a] = 1;
+			if (!c.with_cell) {
+				in_contact[c.id_b] = 1;
+			}
+		}
+	}
+
+	sf::Color getColor(uint64_t atom_id, uint32_t parent) const
+	{
+		switch (coloring) {
+		case AtomColoring::Body: {
+			const uint32_t hash = parent * 2654435761u;
+			return sf::Color(80 + (hash >> 8) % 176, 80 + (hash >> 16) % 176, 80 + (hash >> 24) % 176);
+		}
+		case AtomColoring::Contact:
+			return in_contact[atom_id] ? sf::Color::Yellow : sf::Color::Green;
+		default:
+			return sf::Color::Green;
+		}
+	}
+};
+
+
+// Keeps the grid's quads on the GPU, only the cells changed since the last rendered grid version are uploaded again.
+// Only visible rows are drawn, when cells get too small on screen they are merged into tiles of averaged color
+struct GridRenderer
+{
+	GridRenderer()
+		: min_cell_screen_size(4.0f)
+		, vertices(sf::Quads)
+		, buffer(sf::Quads, sf::VertexBuffer::Static)
+		, use_buffer(sf::VertexBuffer::isAvailable())
+		, info(0, 0, 0)
+		, grid_version(0)
+	{}
+
+	void render(sf::RenderTarget& target, const Grid& grid, const RenderView& view, const sf::RenderStates& rs)
 	{
 		const GridInfo grid_info = grid.getInfo();
-		const int32_t cs = grid_info.cell_size;
-		sf::VertexArray va(sf::Quads, 4 * grid_info.width * grid_info.height);
-		for (int32_t x(0); x < grid_info.width; ++x) {
-			for (int32_t y(0); y < grid_info.height; ++y) {
-				const uint64_t index = x + y * grid_info.width;
-				va[4 * index + 0].position = sf::Vector2f(Tools::as<float>(x * cs), Tools::as<float>(y * cs));
-				va[4 * index + 1].position = sf::Vector2f(Tools::as<float>((x+1) * cs), Tools::as<float>(y * cs));
-				va[4 * index + 2].position = sf::Vector2f(Tools::as<float>((x+1) * cs), Tools::as<float>((y+1) * cs));
-				va[4 * index + 3].position = sf::Vector2f(Tools::as<float>(x * cs), Tools::as<float>((y+1) * cs));
-
-				sf::Color color = sf::Color::White;
-				const uint8_t cell_value = grid.getCellContentAt(x, y);
-				if (cell_value == 1) {
-					color = sf::Color::Black;
+		if (grid_info.width != info.width || grid_info.height != info.height || grid_info.cell_size != info.cell_size) {
+			build(grid);
+		}
+		else if (grid.getVersion() != grid_version) {
+			update(grid);
+		}
+		grid_version = grid.getVersion();
+
+		const int32_t factor = getTilesFactor(view.zoom);
+		if (factor == 1) {
+			drawVisibleRows(view, info.width, info.height, info.cell_size, [&](uint64_t first, uint64_t count) {
+				if (use_buffer) {
+					target.draw(buffer, first, count, rs);
 				}
-				else if (cell_value == 2) {
-					color = sf::Color::Cyan;
+				else {
+					target.draw(&vertices[first], count, sf::Quads, rs);
 				}
+			});
+		}
+		else {
+			const TilesLevel& level = getLevel(grid, factor);
+			drawVisibleRows(view, level.width, level.height, info.cell_size * factor, [&](uint64_t first, uint64_t count) {
+				target.draw(&level.vertices[first], count, sf::Quads, rs);
+			});
+		}
+	}
+
+	float min_cell_screen_size;
+
+private:
+	// Each tile covers factor x factor cells
+	struct TilesLevel
+	{
+		int32_t factor;
+		int32_t width, height;
+		std::vector<sf::Vertex> vertices;
+	};
+
+	sf::VertexArray vertices;
+	sf::VertexBuffer buffer;
+	bool use_buffer;
+	GridInfo info;
+	// Version of the grid the quads were last updated from
+	uint64_t grid_version;
+	std::vector<TilesLevel> levels;
+
+	static sf::Color getCellColor(uint8_t cell_value)
+	{
+		if (cell_value == 1) {
+			return sf::Color::Black;
+		}
+		else if (cell_value == 2) {
+			return sf::Color::Cyan;
+		}
+		return sf::Color::White;
+	}
+
+	static void setQuad(sf::Vertex* quad, float x1, float y1, float x2, float y2)
+	{
+		quad[0].position = sf::Vector2f(x1, y1);
+		quad[1].position = sf::Vector2f(x2, y1);
+		quad[2].position = sf::Vector2f(x2, y2);
+		quad[3].position = sf::Vector2f(x1, y2);
+	}
+
+	static void setQuadColor(sf::Vertex* quad, sf::Color color)
+	{
+		for (uint64_t i(0); i < 4; ++i) {
+			quad[i].color = color;
+		}
+	}
+
+	// Calls draw(first_vertex, vertex_count) for the visible part of each visible row
+	template<typename TDraw>
+	static void drawVisibleRows(const RenderView& view, int32_t width, int32_t height, int32_t tile_size, TDraw&& draw)
+	{
+		const float size = Tools::as<float>(tile_size);
+		const int32_t min_x = std::max(0, Tools::as<int32_t>(std::floor(view.min_x / size)));
+		const int32_t min_y = std::max(0, Tools::as<int32_t>(std::floor(view.min_y / size)));
+		const int32_t max_x = std::min(width - 1, Tools::as<int32_t>(std::floor(view.max_x / size)));
+		const int32_t max_y = std::min(height - 1, Tools::as<int32_t>(std::floor(view.max_y / size)));
+		if (min_x > max_x || min_y > max_y) {
+			return;
+		}
+
+		const uint64_t row_size = Tools::as<uint64_t>(max_x - min_x + 1);
+		for (int32_t y(min_y); y <= max_y; ++y) {
+			draw(4 * (Tools::as<uint64_t>(min_x) + Tools::as<uint64_t>(y) * Tools::as<uint64_t>(width)), 4 * row_size);
+		}
+	}
 
-				va[4 * index + 0].color = color;
-				va[4 * index + 1].color = color;
-				va[4 * index + 2].color = color;
-				va[4 * index + 3].color = color;
+	// Smallest power of two merging enough cells for tiles to be visible on screen
+	int32_t getTilesFactor(float zoom) const
+	{
+		const int32_t max_factor = std::max(info.width, info.height);
+		int32_t factor = 1;
+		while (info.cell_size * factor * zoom < min_cell_screen_size && factor < max_factor) {
+			factor *= 2;
+		}
+		return factor;
+	}
+
+	const TilesLevel& getLevel(const Grid& grid, int32_t factor)
+	{
+		for (const TilesLevel& level : levels) {
+			if (level.factor == factor) {
+				return level;
 			}
 		}
 
-		target.draw(va, rs);
+		levels.emplace_back();
+		TilesLevel& level = levels.back();
+		level.factor = factor;
+		level.width = (info.width + factor - 1) / factor;
+		level.height = (info.height + factor - 1) / factor;
+		level.vertices.resize(4 * Tools::as<uint64_t>(level.width) * Tools::as<uint64_t>(level.height));
+		const int32_t cs = info.cell_size;
+		for (int32_t y(0); y < level.height; ++y) {
+			for (int32_t x(0); x < level.width; ++x) {
+				sf::Vertex* quad = &level.vertices[4 * (x + Tools::as<uint64_t>(y) * level.width)];
+				setQuad(quad, Tools::as<float>(x * factor * cs), Tools::as<float>(y * factor * cs),
+				        Tools::as<float>(std::min((x + 1) * factor, info.width) * cs), Tools::as<float>(std::min((y + 1) * factor, info.height) * cs));
+				updateTile(grid, level, x, y);
+			}
+		}
+		return level;
 	}
 
-	static void renderAtoms(sf::RenderTarget& target, const Solver& solver, const sf::RenderStates& rs)
+	void updateTile(const Grid& grid, TilesLevel& level, int32_t tile_x, int32_t tile_y) const
 	{
-		for (const Atom& a : solver.atoms) {
-			const float radius = a.radius;
-			sf::CircleShape c(radius);
-			c.setOrigin(radius, radius);
-			c.setFillColor(sf::Color::Green);
-			c.setPosition(a.position.x, a.position.y);
-			target.draw(c, rs);
+		uint32_t r = 0, g = 0, b = 0, count = 0;
+		const int32_t end_x = std::min((tile_x + 1) * level.factor, info.width);
+		const int32_t end_y = std::min((tile_y + 1) * level.factor, info.height);
+		for (int32_t y(tile_y * level.factor); y < end_y; ++y) {
+			for (int32_t x(tile_x * level.factor); x < end_x; ++x) {
+				const sf::Color color = getCellColor(grid.getCellContentAt(x, y));
+				r += color.r;
+				g += color.g;
+				b += color.b;
+				++count;
+			}
 		}
+		setQuadColor(&level.vertices[4 * (tile_x + Tools::as<uint64_t>(tile_y) * level.width)], sf::Color(r / count, g / count, b / count));
 	}
 
-	static void renderContacts(sf::RenderTarget& target, const std::list<AtomContact>& contacts, const sf::RenderStates& rs)
+	void updateTiles(const Grid& grid, const GridRegion& region)
 	{
-		sf::VertexArray impulses(sf::Lines, 2 * contacts.size());
-		uint32_t i = 0;
-		for (const AtomContact& c : contacts) {
-			impulses[2 * i].position = sf::Vector2f(c.contact_point.x, c.contact_point.y);
-			impulses[2 * i + 1].position = sf::Vector2f(c.contact_point.x + c.impulse.x, c.contact_point.y + c.impulse.y);
+		for (TilesLevel& level : levels) {
+			for (int32_t y(region.min_y / level.factor); y <= region.max_y / level.factor; ++y) {
+				for (int32_t x(region.min_x / level.factor); x <= region.max_x / level.factor; ++x) {
+					updateTile(grid, level, x, y);
+				}
+			}
+		}
+	}
 
-			const sf::Color color = c.tick_count > 10 ? sf::Color::Blue : sf::Color::Red;
-			impulses[2 * i].color = color;
-			impulses[2 * i + 1].color = color;
-			++i;
+	void build(const Grid& grid)
+	{
+		info = grid.getInfo();
+		levels.clear();
+		const int32_t cs = info.cell_size;
+		vertices.resize(4 * Tools::as<uint64_t>(info.width) * Tools::as<uint64_t>(info.height));
+		for (int32_t y(0); y < info.height; ++y) {
+			for (int32_t x(0); x < info.width; ++x) {
+				const uint64_t index = getIndex(x, y);
+				setQuad(&vertices[4 * index], Tools::as<float>(x * cs), Tools::as<float>(y * cs), Tools::as<float>((x+1) * cs), Tools::as<float>((y+1) * cs));
+				setQuadColor(&vertices[4 * index], getCellColor(grid.getCellContentAt(x, y)));
+			}
 		}
 
-		target.draw(impulses, rs);
+		if (use_buffer) {
+			use_buffer = buffer.create(vertices.getVertexCount()) && (!vertices.getVertexCount() || buffer.update(&vertices[0]));
+		}
+	}
+
+	void update(const Grid& grid)
+	{
+		if (grid.hasChangedCellsSince(grid_version)) {
+			grid.forEachChangedCell(grid_version, [&](uint64_t index) {
+				const int32_t x = Tools::as<int32_t>(index % info.width);
+				const int32_t y = Tools::as<int32_t>(index / info.width);
+				setQuadColor(&vertices[4 * index], getCellColor(grid.getCellContentAt(x, y)));
+				upload(index, 1);
+				GridRegion cell;
+				cell.add(x, y);
+				updateTiles(grid, cell);
+			});
+			return;
+		}
+
+		// Too many cells changed, the changed rows are uploaded instead
+		GridRegion region;
+		for (int32_t y(0); y < info.height; ++y) {
+			if (grid.getRowVersion(y) <= grid_version) {
+				continue;
+			}
+			for (int32_t x(0); x < info.width; ++x) {
+				setQuadColor(&vertices[4 * getIndex(x, y)], getCellColor(grid.getCellContentAt(x, y)));
+			}
+			upload(getIndex(0, y), Tools::as<uint64_t>(info.width));
+			region.add(0, y);
+			region.add(info.width - 1, y);
+		}
+		updateTiles(grid, region);
+	}
+
+	void upload(uint64_t first_cell, uint64_t cells_count)
+	{
+		if (use_buffer) {
+			buffer.update(&vertices[4 * first_cell], 4 * cells_count, Tools::as<uint32_t>(4 * first_cell));
+		}
+	}
+
+	uint64_t getIndex(int32_t x, int32_t y) const
+	{
+		return Tools::as<uint64_t>(x) + Tools::as<uint64_t>(y) * Tools::as<uint64_t>(info.width);
 	}
 };
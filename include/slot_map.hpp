@@ -0,0 +1,143 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+
+struct SlotHandle
+{
+	uint32_t index;
+	uint32_t generation;
+};
+
+
+// Contiguous storage where items keep their slot for their whole life, so slot indices can be stored
+// in other structures. Removed slots are reused, handles carry a generation to detect stale accesses
+template<typename T>
+struct SlotMap
+{
+	struct Iterator
+	{
+		Iterator(SlotMap& map_, uint32_t index_)
+			: map(map_)
+			, index(index_)
+		{
+			skipDead();
+		}
+
+		T& operator*() const
+		{
+			return map.items[index];
+		}
+
+		Iterator& operator++()
+		{
+			++index;
+			skipDead();
+			return *this;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return index != other.index;
+		}
+
+		void skipDead()
+		{
+			while (index < map.size() && !map.isAlive(index)) {
+				++index;
+			}
+		}
+
+		SlotMap& map;
+		uint32_t index;
+	};
+
+	SlotHandle add()
+	{
+		uint32_t index;
+		if (free_slots.empty()) {
+			index = size();
+			items.emplace_back();
+			generations.push_back(0);
+			alive.push_back(1);
+		}
+		else {
+			index = free_slots.back();
+			free_slots.pop_back();
+			alive[index] = 1;
+		}
+		return SlotHandle{ index, generations[index] };
+	}
+
+	void remove(SlotHandle handle)
+	{
+		if (!isValid(handle)) {
+			return;
+		}
+		items[handle.index] = T();
+		alive[handle.index] = 0;
+		++generations[handle.index];
+		free_slots.push_back(handle.index);
+	}
+
+	bool isValid(SlotHandle handle) const
+	{
+		return handle.index < size() && alive[handle.index] && generations[handle.index] == handle.generation;
+	}
+
+	T* get(SlotHandle handle)
+	{
+		return isValid(handle) ? &items[handle.index] : nullptr;
+	}
+
+	bool isAlive(uint32_t index) const
+	{
+		return alive[index];
+	}
+
+	// Direct slot access for indices stored by the solver
+	T& operator[](uint64_t index)
+	{
+		return items[index];
+	}
+
+	const T& operator[](uint64_t index) const
+	{
+		return items[index];
+	}
+
+	// Number of slots, alive or not
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(items.size());
+	}
+
+	uint32_t getAliveCount() const
+	{
+		return size() - static_cast<uint32_t>(free_slots.size());
+	}
+
+	void reserve(uint32_t count)
+	{
+		items.reserve(count);
+		generations.reserve(count);
+		alive.reserve(count);
+		free_slots.reserve(count);
+	}
+
+	Iterator begin()
+	{
+		return Iterator(*this, 0);
+	}
+
+	Iterator end()
+	{
+		return Iterator(*this, size());
+	}
+
+private:
+	std::vector<T> items;
+	std::vector<uint32_t> generations;
+	std::vector<uint8_t> alive;
+	std::vector<uint32_t> free_slots;
+};
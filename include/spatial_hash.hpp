@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include "physic_objects.hpp"
+
+
+struct SpatialHash
+{
+	SpatialHash()
+		: cell_size(1.0f)
+		, inv_cell_size(1.0f)
+		, table_mask(0)
+	{}
+
+	// Buckets atoms by cell using a counting sort, cells are hashed so the world doesn't need to be bounded
+	void build(const AtomStorage& atoms, float cell_size_)
+	{
+		cell_size = cell_size_;
+		inv_cell_size = 1.0f / cell_size;
+
+		const uint64_t atoms_count = atoms.size();
+		uint64_t table_size = 1;
+		while (table_size < 2 * atoms_count) {
+			table_size <<= 1;
+		}
+		table_mask = table_size - 1;
+
+		cell_start.assign(table_size + 1, 0);
+		atoms_buckets.resize(atoms_count);
+		for (uint64_t i(0); i < atoms_count; ++i) {
+			const uint64_t bucket = getBucket(getCellCoord(atoms.x[i]), getCellCoord(atoms.y[i]));
+			atoms_buckets[i] = bucket;
+			++cell_start[bucket];
+		}
+
+		uint64_t sum = 0;
+		for (uint64_t& start : cell_start) {
+			sum += start;
+			start = sum;
+		}
+
+		sorted_ids.resize(atoms_count);
+		for (uint64_t i(atoms_count); i--;) {
+			sorted_ids[--cell_start[atoms_buckets[i]]] = i;
+		}
+	}
+
+	// Calls callback with the id of every atom in the 3x3 cells around position
+	template<typename TCallback>
+	void forEachNeighbour(const Vec2& position, TCallback&& callback) const
+	{
+		const int32_t cell_x = getCellCoord(position.x);
+		const int32_t cell_y = getCellCoord(position.y);
+
+		uint64_t visited[9];
+		uint32_t visited_count = 0;
+		for (int32_t dx(-1); dx < 2; ++dx) {
+			for (int32_t dy(-1); dy < 2; ++dy) {
+				const uint64_t bucket = getBucket(cell_x + dx, cell_y + dy);
+				// Different cells can share a bucket, don't report their atoms twice
+				bool already_visited = false;
+				for (uint32_t i(0); i < visited_count; ++i) {
+					already_visited |= (visited[i] == bucket);
+				}
+				if (already_visited) {
+					continue;
+				}
+				visited[visited_count++] = bucket;
+
+				for (uint64_t i(cell_start[bucket]); i < cell_start[bucket + 1]; ++i) {
+					callback(sorted_ids[i]);
+				}
+			}
+		}
+	}
+
+	int32_t getCellCoord(float coord) const
+	{
+		return static_cast<int32_t>(std::floor(coord * inv_cell_size));
+	}
+
+	uint64_t getBucket(int32_t x, int32_t y) const
+	{
+		const uint64_t hash = (static_cast<uint64_t>(static_cast<uint32_t>(x)) * 73856093u) ^ (static_cast<uint64_t>(static_cast<uint32_t>(y)) * 19349663u);
+		return hash & table_mask;
+	}
+
+	float cell_size;
+	float inv_cell_size;
+	uint64_t table_mask;
+
+	std::vector<uint64_t> cell_start;
+	std::vector<uint64_t> sorted_ids;
+	std::vector<uint64_t> atoms_buckets;
+};
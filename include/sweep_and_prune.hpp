@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include "physic_objects.hpp"
+#include "pair_cache.hpp"
+
+
+struct SweepEndPoint
+{
+	float value;
+	uint32_t atom_id;
+	bool is_max;
+};
+
+
+// Incremental sort and sweep, endpoint lists are kept sorted across frames so that
+// insertion sort only does work for endpoints that actually swapped since last step
+struct SweepAndPrune
+{
+	SweepAndPrune()
+		: atoms_count(0)
+		, swaps_count(0)
+	{}
+
+	void update(const AtomStorage& atoms)
+	{
+		swaps_count = 0;
+		// New atoms are appended and inserted at their place by the sort
+		for (uint64_t i(atoms_count); i < atoms.size(); ++i) {
+			for (std::vector<SweepEndPoint>& axis : axes) {
+				axis.push_back({ 0.0f, static_cast<uint32_t>(i), false });
+				axis.push_back({ 0.0f, static_cast<uint32_t>(i), true });
+			}
+		}
+		atoms_count = atoms.size();
+
+		for (uint32_t axis(0); axis < 2; ++axis) {
+			updateValues(axis, atoms);
+			sort(axis, atoms);
+		}
+	}
+
+	template<typename TCallback>
+	void forEachOverlap(TCallback&& callback) const
+	{
+		overlaps.forEach(callback);
+	}
+
+	uint64_t atoms_count;
+	uint64_t swaps_count;
+	std::vector<SweepEndPoint> axes[2];
+	PairCache overlaps;
+
+private:
+	static const std::vector<float>& getCoords(const AtomStorage& atoms, uint32_t axis)
+	{
+		return axis ? atoms.y : atoms.x;
+	}
+
+	void updateValues(uint32_t axis, const AtomStorage& atoms)
+	{
+		const std::vector<float>& coords = getCoords(atoms, axis);
+		for (SweepEndPoint& e : axes[axis]) {
+			const float coord = coords[e.atom_id];
+			const float radius = atoms.radius[e.atom_id];
+			e.value = e.is_max ? coord + radius : coord - radius;
+		}
+	}
+
+	void sort(uint32_t axis, const AtomStorage& atoms)
+	{
+		std::vector<SweepEndPoint>& endpoints = axes[axis];
+		const uint64_t count = endpoints.size();
+		for (uint64_t i(1); i < count; ++i) {
+			const SweepEndPoint current = endpoints[i];
+			uint64_t k = i;
+			while (k > 0 && isAfter(endpoints[k - 1], current)) {
+				const SweepEndPoint& passed = endpoints[k - 1];
+				// A min passing a max to its left starts an overlap on this axis, the opposite ends one
+				if (!current.is_max && passed.is_max) {
+					if (overlap(current.atom_id, passed.atom_id, atoms)) {
+						overlaps.insert(current.atom_id, passed.atom_id);
+					}
+				}
+				else if (current.is_max && !passed.is_max) {
+					overlaps.remove(current.atom_id, passed.atom_id);
+				}
+				endpoints[k] = passed;
+				--k;
+				++swaps_count;
+			}
+			endpoints[k] = current;
+		}
+	}
+
+	// On ties maxs come first so that touching intervals are not considered overlapping
+	static bool isAfter(const SweepEndPoint& e1, const SweepEndPoint& e2)
+	{
+		return e1.value > e2.value || (e1.value == e2.value && !e1.is_max && e2.is_max);
+	}
+
+	// Uses the same expressions as the endpoints to stay consistent with the sort
+	static bool overlap(uint64_t i, uint64_t k, const AtomStorage& atoms)
+	{
+		const float radius_a = atoms.radius[i];
+		const float radius_b = atoms.radius[k];
+		for (uint32_t axis(0); axis < 2; ++axis) {
+			const std::vector<float>& coords = getCoords(atoms, axis);
+			const float coord_a = coords[i];
+			const float coord_b = coords[k];
+			if (coord_a - radius_a >= coord_b + radius_b || coord_b - radius_b >= coord_a + radius_a) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
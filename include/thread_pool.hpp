@@ -0,0 +1,126 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+
+
+// Fixed set of workers running parallel for loops, the calling thread takes part in the work
+struct ThreadPool
+{
+	ThreadPool(uint32_t threads_count = 0)
+		: generation(0)
+		, jobs_count(0)
+		, next_index(0)
+		, active_workers(0)
+		, job_context(nullptr)
+		, job_invoke(nullptr)
+		, stop(false)
+	{
+		if (!threads_count) {
+			threads_count = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (uint32_t i(1); i < threads_count; ++i) {
+			workers.emplace_back([this]() { workerLoop(); });
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		condition.notify_all();
+		for (std::thread& t : workers) {
+			t.join();
+		}
+	}
+
+	// Calls job(i) for each i in [0, count) and returns once all are done.
+	// Indices are handed out in increasing order, put the biggest jobs first
+	template<typename TJob>
+	void parallelFor(uint32_t count, TJob&& job)
+	{
+		if (!count) {
+			return;
+		}
+		if (workers.empty() || count == 1) {
+			for (uint32_t i(0); i < count; ++i) {
+				job(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job_context = &job;
+			job_invoke = [](void* context, uint32_t i) { (*static_cast<typename std::remove_reference<TJob>::type*>(context))(i); };
+			jobs_count = count;
+			next_index = 0;
+			active_workers = static_cast<uint32_t>(workers.size());
+			++generation;
+		}
+		condition.notify_all();
+		runJobs();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done_condition.wait(lock, [this]() { return active_workers == 0; });
+		job_context = nullptr;
+	}
+
+	uint32_t getThreadsCount() const
+	{
+		return static_cast<uint32_t>(workers.size()) + 1;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::condition_variable done_condition;
+
+	uint64_t generation;
+	uint32_t jobs_count;
+	std::atomic<uint32_t> next_index;
+	uint32_t active_workers;
+	void* job_context;
+	void (*job_invoke)(void*, uint32_t);
+	bool stop;
+
+	void runJobs()
+	{
+		for (uint32_t i(next_index++); i < jobs_count; i = next_index++) {
+			job_invoke(job_context, i);
+		}
+	}
+
+	void workerLoop()
+	{
+		uint64_t last_generation = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return stop || generation != last_generation; });
+				if (stop) {
+					return;
+				}
+				last_generation = generation;
+			}
+
+			runJobs();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active_workers == 0) {
+				done_condition.notify_one();
+			}
+		}
+	}
+};
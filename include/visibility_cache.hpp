@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <SFML/System/Vector2.hpp>
+#include "grid.hpp"
+#include "sfml_tools.hpp"
+
+
+// Line of sight results of Grid::castRayToPoint keyed by the start and end cells. Positions in the same
+// cells share the result of the first ray cast between them. Entries are tagged with Grid::getVersion so
+// any cell change makes them stale without clearing the cache. Colliding keys replace each other
+struct VisibilityCache
+{
+	VisibilityCache(uint32_t capacity = 4096)
+		: hits_count(0)
+		, misses_count(0)
+	{
+		uint32_t size = 1;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		entries.resize(size);
+	}
+
+	// Returns true if the result is in the cache, visible is then set
+	bool find(const Grid& grid, const sf::Vector2f& start, const sf::Vector2f& end, bool& visible)
+	{
+		const Key key = getKey(grid, start, end);
+		const Entry& entry = entries[getSlot(key)];
+		if (entry.version == grid.getVersion() + 1 && entry.key == key) {
+			++hits_count;
+			visible = entry.visible;
+			return true;
+		}
+		++misses_count;
+		return false;
+	}
+
+	void insert(const Grid& grid, const sf::Vector2f& start, const sf::Vector2f& end, bool visible)
+	{
+		const Key key = getKey(grid, start, end);
+		Entry& entry = entries[getSlot(key)];
+		entry.key = key;
+		entry.version = grid.getVersion() + 1;
+		entry.visible = visible;
+	}
+
+	bool isVisible(const Grid& grid, const sf::Vector2f& start, const sf::Vector2f& end)
+	{
+		bool visible;
+		if (!find(grid, start, end, visible)) {
+			visible = !grid.castRayToPoint(start, end).hit;
+			insert(grid, start, end, visible);
+		}
+		return visible;
+	}
+
+	uint64_t getHitsCount() const
+	{
+		return hits_count;
+	}
+
+	uint64_t getMissesCount() const
+	{
+		return misses_count;
+	}
+
+private:
+	struct Key
+	{
+		uint64_t start;
+		uint64_t end;
+
+		bool operator==(const Key& other) const
+		{
+			return start == other.start && end == other.end;
+		}
+	};
+
+	struct Entry
+	{
+		Key key{ 0, 0 };
+		// Grid version + 1, 0 for empty entries
+		uint64_t version = 0;
+		bool visible = false;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t hits_count;
+	uint64_t misses_count;
+
+	static uint64_t getCellKey(const sf::Vector2f& position, float cell_size)
+	{
+		const uint32_t x = static_cast<uint32_t>(Tools::as<int32_t>(position.x / cell_size));
+		const uint32_t y = static_cast<uint32_t>(Tools::as<int32_t>(position.y / cell_size));
+		return (static_cast<uint64_t>(x) << 32) | y;
+	}
+
+	static Key getKey(const Grid& grid, const sf::Vector2f& start, const sf::Vector2f& end)
+	{
+		const float cell_size = Tools::as<float>(grid.getInfo().cell_size);
+		return Key{ getCellKey(start, cell_size), getCellKey(end, cell_size) };
+	}
+
+	uint64_t getSlot(const Key& key) const
+	{
+		uint64_t hash = key.start * 0x9E3779B97F4A7C15ull ^ key.end * 0xC2B2AE3D27D4EB4Full;
+		hash ^= hash >> 29;
+		return hash & (entries.size() - 1);
+	}
+};
@@ -88,6 +88,14 @@ sf::Vector2f DisplayManager::displayCoordToWorldCoord(const sf::Vector2f& viewCo
     return sf::Vector2f(worldCoordX, worldCoordY);
 }
 
+sf::FloatRect DisplayManager::getVisibleWorldRect() const
+{
+	const sf::Vector2f top_left = displayCoordToWorldCoord(sf::Vector2f(0.0f, 0.0f));
+	const sf::Vector2f bottom_right = displayCoordToWorldCoord(sf::Vector2f(static_cast<float>(m_window.getSize().x), static_cast<float>(m_window.getSize().y)));
+
+	return sf::FloatRect(top_left.x, top_left.y, bottom_right.x - top_left.x, bottom_right.y - top_left.y);
+}
+
 sf::RenderStates DisplayManager::getRenderStates() const
 {
 	sf::RenderStates rs;
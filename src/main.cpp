@@ -4,12 +4,14 @@
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <memory>
 
 #include "display_manager.hpp"
 #include "grid.hpp"
 #include "render.hpp"
 #include "agent.hpp"
 #include "physic.hpp"
+#include "physic_thread.hpp"
 
 
 int main()
@@ -32,35 +34,67 @@ int main()
     bool step = false;
     const float atom_radius = 8.0f;
 
-    solver.objects.emplace_back();
-    solver.objects.back().moving = false;
-    for (uint32_t x(0); x < WinWidth / (2.0f * atom_radius); ++x) {
-        solver.addAtomToLastObject(Vec2(0.0f + x * 2.0f * atom_radius, WinHeight));
+    // The world's borders are solid cells the atoms collide with
+    const GridInfo grid_info = grid.getInfo();
+    for (int32_t x(0); x < grid_info.width; ++x) {
+        grid.setCellAt(x, 0, 1);
+        grid.setCellAt(x, grid_info.height - 1, 1);
     }
-    for (uint32_t x(0); x < WinWidth / (2.0f * atom_radius); ++x) {
-        solver.addAtomToLastObject(Vec2(0.0f + x * 2.0f * atom_radius, 0.0f));
-    }
-    for (uint32_t y(0); y < WinHeight / (2.0f * atom_radius); ++y) {
-        solver.addAtomToLastObject(Vec2(0.0f, y * 2.0f * atom_radius));
-    }
-    for (uint32_t y(0); y < WinHeight / (2.0f * atom_radius); ++y) {
-        solver.addAtomToLastObject(Vec2(WinWidth, y * 2.0f * atom_radius));
+    for (int32_t y(0); y < grid_info.height; ++y) {
+        grid.setCellAt(0, y, 1);
+        grid.setCellAt(grid_info.width - 1, y, 1);
     }
+    solver.setGrid(&grid);
 
 	DisplayManager display_manager(window);
 
+    const float dt = 0.016f;
+    // When set, the solver runs on its own thread and is drawn from its snapshots
+    std::unique_ptr<PhysicThread> physic_thread;
+    bool interpolate = true;
+    AtomsRenderer atoms_renderer;
+    GridRenderer grid_renderer;
+    // Runs on the physic thread when it is active
+    const auto with_solver = [&](const PhysicThread::Command& command) {
+        if (physic_thread) {
+            physic_thread->post(command);
+        }
+        else {
+            command(solver);
+        }
+    };
+
     display_manager.event_manager.addKeyPressedCallback(sf::Keyboard::E, [&](const sf::Event& ev) {
-        solver.objects.emplace_back();
-        solver.objects.back().angular_velocity = -2.0f;
-        uint32_t w = 5;
-        uint32_t h = 5;
-        for (uint32_t x(0); x < w; ++x) {
-            for (uint32_t y(0); y < h; ++y) {
-                solver.addAtomToLastObject(Vec2(800.0f + x * 2.0f * atom_radius + rand()%2, 350.0f + y * 2.0f * atom_radius));
+        with_solver([atom_radius](Solver& s) {
+            s.addObject().angular_velocity = -2.0f;
+            uint32_t w = 5;
+            uint32_t h = 5;
+            for (uint32_t x(0); x < w; ++x) {
+                for (uint32_t y(0); y < h; ++y) {
+                    s.addAtomToLastObject(Vec2(800.0f + x * 2.0f * atom_radius + rand()%2, 350.0f + y * 2.0f * atom_radius));
+                }
             }
+        });
+    });
+
+    display_manager.event_manager.addKeyPressedCallback(sf::Keyboard::T, [&](const sf::Event& ev) {
+        if (physic_thread) {
+            physic_thread.reset();
+        }
+        else {
+            physic_thread.reset(new PhysicThread(solver, dt));
         }
     });
 
+    display_manager.event_manager.addKeyPressedCallback(sf::Keyboard::I, [&](const sf::Event& ev) {
+        interpolate = !interpolate;
+    });
+
+    // Cycles between uniform, per body and contact coloring
+    display_manager.event_manager.addKeyPressedCallback(sf::Keyboard::C, [&](const sf::Event& ev) {
+        atoms_renderer.coloring = static_cast<AtomColoring>((static_cast<uint32_t>(atoms_renderer.coloring) + 1) % 3);
+    });
+
     display_manager.event_manager.addKeyPressedCallback(sf::Keyboard::Space, [&](const sf::Event& ev) {
         step = true;
     });
@@ -69,27 +103,38 @@ int main()
         pause = !pause;
     });
 
-    const float dt = 0.016f;
-
     while (window.isOpen()) {
         display_manager.processEvents();
         const sf::Vector2i mouse_pos = sf::Mouse::getPosition(window);
 
         if (pause) {
-            solver.objects.emplace_back();
-            solver.addAtomToLastObject(Vec2(800.0f + rand() % 2, 350.0f));
+            with_solver([](Solver& s) {
+                s.addObject();
+                s.addAtomToLastObject(Vec2(800.0f + rand() % 2, 350.0f));
+            });
         }
 
-        
-		solver.update(dt);
+        if (!physic_thread) {
+            solver.update(dt);
+        }
 		step = false;
 
         window.clear(sf::Color::Black);
 
         const sf::RenderStates rs = display_manager.getRenderStates();
-
-        Renderer::renderAtoms(window, solver, rs);
-        Renderer::renderContacts(window, solver.atom_contacts, rs);
+        const RenderView view(display_manager.getVisibleWorldRect(), display_manager.getZoom());
+        grid_renderer.render(window, grid, view, rs);
+
+        if (physic_thread) {
+            const PhysicSnapshot& snapshot = physic_thread->getSnapshot();
+            const float ratio = interpolate ? snapshot.getInterpolationRatio(PhysicSnapshot::Clock::now()) : 1.0f;
+            atoms_renderer.render(window, snapshot, ratio, view, rs);
+            Renderer::renderContacts(window, snapshot.contacts, view, rs);
+        }
+        else {
+            atoms_renderer.render(window, solver, view, rs);
+            Renderer::renderContacts(window, solver.atom_contacts, view, rs);
+        }
 
 		window.display();
     }